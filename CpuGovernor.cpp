@@ -0,0 +1,138 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#include "CpuGovernor.h"
+
+CpuGovernor::CpuGovernor() : enabled_(true) {
+    reset(1, 1, 1, 1, 5000);
+}
+
+// hold_us の時間に相当するブロック数（1 以上）
+int CpuGovernor::holdBlocks(uint32_t hold_us, uint32_t deadline_us) {
+    if (deadline_us == 0) {
+        return 1;
+    }
+    const uint32_t blocks = (hold_us + deadline_us / 2) / deadline_us;
+    return (blocks < 1) ? 1 : (int)blocks;
+}
+
+void CpuGovernor::reset(int min_voices, int max_voices, int step, int initial, uint32_t deadline_us) {
+    step_ = (step < 1) ? 1 : step;
+    min_ = (min_voices < step_) ? step_ : min_voices / step_ * step_;
+    max_ = (max_voices < min_) ? min_ : max_voices / step_ * step_;
+    deadline_us_ = deadline_us;
+    raise_hold_blocks_ = holdBlocks(kRaiseHoldUs, deadline_us);
+    lower_hold_blocks_ = holdBlocks(kLowerHoldUs, deadline_us);
+    fixed_q8_ = 0;
+    voice_q8_ = 0;
+    raise_count_ = 0;
+    rhythm_count_ = 0;
+    lower_hold_ = 0;
+    rhythm_allowed_ = false;
+    rhythm_ = false;
+    rhythm_max_ = max_;
+    setVoiceLimit(initial);
+}
+
+void CpuGovernor::setRhythm(bool on, int max_voices) {
+    rhythm_ = on;
+    rhythm_max_ = max_voices / step_ * step_;
+    rhythm_count_ = 0;
+    if (limit_ > getMaxLimit()) {
+        limit_ = (getMaxLimit() < min_) ? min_ : getMaxLimit();
+    }
+}
+
+void CpuGovernor::setVoiceLimit(int limit) {
+    limit = limit / step_ * step_;
+    limit_ = (limit < min_) ? min_ : ((limit > getMaxLimit()) ? getMaxLimit() : limit);
+}
+
+int CpuGovernor::getAffordableVoices() const {
+    if (voice_q8_ == 0) {
+        // まだ推定できていなければ、今の上限のまま
+        return limit_;
+    }
+
+    const uint32_t target_q8 = (deadline_us_ * kTargetPercent / 100) << 8;
+    if (target_q8 <= fixed_q8_) {
+        return 0;
+    }
+    return (int)((target_q8 - fixed_q8_) / voice_q8_);
+}
+
+bool CpuGovernor::lower() {
+    if (limit_ - step_ < min_ || lower_hold_ > 0) {
+        return false;
+    }
+    limit_ -= step_;
+    lower_hold_ = lower_hold_blocks_;
+    raise_count_ = 0;
+    return true;
+}
+
+bool CpuGovernor::update(uint32_t render_us, int active) {
+    // 負荷の推定
+    const uint32_t t_q8 = render_us << 8;
+    if (active <= 0) {
+        fixed_q8_ = fixed_q8_ + ((int32_t)(t_q8 - fixed_q8_) >> kEmaShift);
+    } else {
+        const uint32_t per_q8 = (t_q8 > fixed_q8_) ? (t_q8 - fixed_q8_) / active : 0;
+        if (voice_q8_ == 0) {
+            voice_q8_ = (per_q8 > 0) ? per_q8 : 1;
+        } else {
+            voice_q8_ = voice_q8_ + ((int32_t)(per_q8 - voice_q8_) >> kEmaShift);
+            if (voice_q8_ == 0) {
+                voice_q8_ = 1;
+            }
+        }
+    }
+
+    if (lower_hold_ > 0) {
+        lower_hold_--;
+    }
+    if (!enabled_) {
+        return false;
+    }
+
+    const int affordable = getAffordableVoices();
+    const bool overload = render_us * 100 >= deadline_us_ * kOverloadPercent;
+    const int reserved = rhythm_ ? kRhythmCost : 0;
+
+    if (rhythm_) {
+        // リズムモードを使っている間は、先にメロディの上限を下げて、最小の上限でも間に合わなくなったらやめる
+        rhythm_allowed_ = affordable >= min_ + kRhythmCost;
+    } else {
+        // 使っていなければ、リズムモードの上限いっぱいのボイスに加えて鳴らせる余裕が続いたときに許す
+        const int limit = (limit_ < rhythm_max_) ? limit_ : rhythm_max_;
+        if (affordable >= limit + kRhythmCost && !overload) {
+            if (!rhythm_allowed_ && ++rhythm_count_ >= raise_hold_blocks_) {
+                rhythm_allowed_ = true;
+            }
+        } else {
+            rhythm_allowed_ = false;
+            rhythm_count_ = 0;
+        }
+    }
+
+    // 締め切りに近づいたブロックがあるか、上限いっぱいでは間に合わない見込みなら下げる
+    if (overload || affordable < limit_ + reserved) {
+        return lower();
+    }
+
+    // 1 段上げても間に合う見込みの状態が続いたら上げる
+    if (affordable >= limit_ + step_ + reserved && limit_ + step_ <= getMaxLimit()) {
+        if (++raise_count_ >= raise_hold_blocks_) {
+            limit_ += step_;
+            raise_count_ = 0;
+            return true;
+        }
+    } else {
+        raise_count_ = 0;
+    }
+
+    return false;
+}
@@ -0,0 +1,83 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#ifndef CPUGOVERNOR_H_
+#define CPUGOVERNOR_H_
+
+#include <stdint.h>
+
+// ブロックの生成にかかった時間から、処理が間に合う発音数の上限を決める
+//
+// 鳴っているボイスがないときの時間を固定の負荷、それを引いた残りを鳴っているボイス数で割ったものを
+// 1 ボイスあたりの負荷として、それぞれ指数移動平均で推定する。上限いっぱいのボイスが鳴っても
+// 目標の負荷（締め切りの kTargetPercent %）に収まる数を上限とする。
+// 上限を下げるのはすぐに、上げるのは余裕のある状態が kRaiseHoldUs 続いてから行う（ヒステリシス）。
+// 待つ時間はブロックの大きさによらないように、reset() で 1 ブロックの時間からブロック数に換算する。
+// 締め切りの kOverloadPercent % を超えたブロックがあれば、推定によらず上限を下げる。
+class CpuGovernor {
+public:
+    static const int kTargetPercent = 70;
+    static const int kOverloadPercent = 90;
+    static const uint32_t kRaiseHoldUs = 1000000;  // 上限を上げる（リズムモードを許す）までに余裕が続く時間
+    static const uint32_t kLowerHoldUs = 100000;   // 上限を下げてから、次に下げるまでの間隔
+    static const int kRhythmCost = 3;         // リズムモードの負荷（ボイス数換算）
+
+    CpuGovernor();
+
+    // step: 上限を増減させる単位（ボイス数）。上限は min_voices から max_voices の間の step の倍数になる
+    // deadline_us: 1 ブロックの時間
+    void reset(int min_voices, int max_voices, int step, int initial, uint32_t deadline_us);
+
+    void setEnabled(bool enabled) { enabled_ = enabled; }
+    bool isEnabled() const { return enabled_; }
+
+    // 1 ブロックごとに呼ぶ。render_us: 生成にかかった時間、active: 生成中に鳴っていたボイス数
+    // （リズムモードで鳴らしていれば kRhythmCost を足す）。上限が変わったら true を返す
+    bool update(uint32_t render_us, int active);
+
+    // 無効にしているときに使う上限
+    void setVoiceLimit(int limit);
+
+    // リズムモードを使っているか。使っている間は上限を max_voices までにして、
+    // リズム音の負荷 (kRhythmCost) も見込んで上限を決める
+    void setRhythm(bool on, int max_voices);
+
+    int getVoiceLimit() const { return limit_; }
+    bool isRhythmAllowed() const { return rhythm_allowed_; }
+
+    // 推定した負荷 (us / ブロック)
+    uint32_t getFixedCost() const { return fixed_q8_ >> 8; }
+    uint32_t getVoiceCost() const { return voice_q8_ >> 8; }
+
+    // 処理が間に合うと見込めるボイス数（リズムモードの負荷もボイス数換算で含む）
+    int getAffordableVoices() const;
+
+private:
+    static const int kEmaShift = 4;  // 指数移動平均の時定数（2^kEmaShift ブロック）
+
+    bool enabled_;
+    int min_;
+    int max_;
+    int step_;
+    int limit_;
+    bool rhythm_allowed_;
+    bool rhythm_;         // リズムモードを使っている
+    int rhythm_max_;      // リズムモードを使っている間の上限
+    uint32_t deadline_us_;
+    int raise_hold_blocks_;  // kRaiseHoldUs をブロック数に換算したもの
+    int lower_hold_blocks_;  // kLowerHoldUs をブロック数に換算したもの
+    uint32_t fixed_q8_;   // 固定の負荷 (us << 8)
+    uint32_t voice_q8_;   // 1 ボイスあたりの負荷 (us << 8)、0 ならまだ推定できていない
+    int raise_count_;     // 上限を上げられる状態が続いたブロック数
+    int rhythm_count_;    // リズムモードを許せる状態が続いたブロック数
+    int lower_hold_;      // 次に上限を下げられるまでのブロック数
+
+    static int holdBlocks(uint32_t hold_us, uint32_t deadline_us);
+    bool lower();
+    int getMaxLimit() const { return (rhythm_ && rhythm_max_ < max_) ? rhythm_max_ : max_; }
+};
+
+#endif  // CPUGOVERNOR_H_
@@ -6,137 +6,1051 @@
 
 #if defined(ARDUINO_ARCH_SPRESENSE) && !defined(SUBCORE)
 
-#include <math.h>
 #include "FMTGSink.h"
 
 #include <SDHCI.h>
 
+#include <string.h>
+
 // playback parameters
 const int kPbSampleFrq = 48000;
 const int kPbBitDepth = 16;
-const int kPbChannelCount = 2;
-const int kPbSampleCount = 240;
-const int kPbBlockSize = kPbSampleCount * (kPbBitDepth / 8) * kPbChannelCount;
-const int kPbCacheSize = (2 * 1024);
-
-const int kPbBytePerSec = kPbSampleFrq * (kPbBitDepth / 8) * kPbChannelCount;
+const int kPbMaxSampleCount = FMTGSINK_MAX_BLOCK_SAMPLES;
 
 const int kVolumeMin = -1020;
 const int kVolumeMax = 120;
 
 // cache parameter
-const int kPreloadFrameNum = 3;
 const int kLoadFrameNum = 10;
 
+// レイテンシーのモードごとの設定
+struct LatencyConfig {
+    int sample_count;        // 1 ブロックのサンプル数 (<= kPbMaxSampleCount)
+    int cache_frame_num;     // レンダラーのバッファの大きさ（サンプル数。バイト数は出力のチャンネル数で決まる）
+    int preload_frame_num;   // 再生を始める前に先読みするブロック数
+};
+
+static const LatencyConfig kLatencyConfigs[FMTGSink::kLatencyModeNum] = {
+    { 120, 256,  2 },  // kLatencyLow    (ステレオで 1KB)
+    { 240, 512,  3 },  // kLatencyNormal (ステレオで 2KB)
+    { 240, 2048, 4 },  // kLatencySafe   (ステレオで 8KB)
+};
+
 // OPLL parameter
-constexpr int kOpllClk = 3456000; // = 48000 * 72
+#if defined(FMTGSINK_NATIVE_CLOCK)
+constexpr int kOpllClk = 3579545; // 実チップのクロック (emu2413 内部のレートコンバータで 48kHz に変換する)
+#else
+constexpr int kOpllClk = 3456000; // = 48000 * 72 (レートコンバータを使わない)
+#endif
 constexpr int kFreqA4 = 440; // Hz
-constexpr int kFnumA4 = kFreqA4 * 262144 /* = 2^18 */ / kPbSampleFrq / 16 /* = 2^oct */;
+constexpr int kFnumA4 = kFreqA4 * 262144LL /* = 2^18 */ * 72 / kOpllClk / 16 /* = 2^oct */;
 
 constexpr int kDefaultInstNo = 1; // Violin
 
-static uint32_t msToSa(int ms) {
-    return kPbSampleFrq * ms / 1000 * (kPbBitDepth / 8) * kPbChannelCount;
+// RPN
+constexpr uint16_t kRpnBendRange = 0x0000;
+constexpr uint16_t kRpnFineTune = 0x0001;
+constexpr uint16_t kRpnCoarseTune = 0x0002;
+constexpr uint16_t kRpnNull = 0x3fff;
+constexpr uint16_t kDefaultBendRange = 2 << 7;  // 2 半音
+
+// MIDI event timing
+constexpr int kMaxEventDriftBlocks = 2;  // ブロックの時刻が再生位置からこれ以上ずれたら合わせ直す
+
+// voice governor
+constexpr uint32_t kShrinkWaitUs = 1000000;  // 外したボイスのリリースを待つ時間
+
+// pan
+constexpr uint8_t kPanCenter = 64;
+
+// rhythm
+constexpr uint8_t kDrumChannel = 9;  // MIDI チャンネル 10
+constexpr uint8_t kRhythmBD = 0x10;  // レジスタ 0x0e のキーオンのビット
+constexpr uint8_t kRhythmSD = 0x08;
+constexpr uint8_t kRhythmTOM = 0x04;
+constexpr uint8_t kRhythmCYM = 0x02;
+constexpr uint8_t kRhythmHH = 0x01;
+
+// profiling
+#if FMTGSINK_PROFILE
+#ifndef F_CPU
+#define F_CPU 156000000  // CXD5602 のメインコアのクロック
+#endif
+constexpr int kProfileHistNum = StageProfiler::kStageNum * StageProfiler::kHistBins;
+
+#define PROFILE_START(t) const uint32_t t = StageProfiler::now()
+#define PROFILE_STOP(stage, t) profiler_.add(StageProfiler::stage, StageProfiler::now() - (t))
+#else
+#define PROFILE_START(t)
+#define PROFILE_STOP(stage, t)
+#endif
+
+static_assert(FMTGSINK_MAX_CHIPS <= VoiceAllocator::kMaxGroups, "too many chips");
+static_assert(FMTGSINK_MAX_CHIPS * FMTGSINK_MAX_VOICES <= VoiceAllocator::kMaxVoices, "too many voices");
+static_assert(FMTGSINK_OUTPUT_CHANNELS == 1 || FMTGSINK_OUTPUT_CHANNELS == 2, "invalid channel count");
+static_assert(0 <= FMTGSINK_RHYTHM_MODE && FMTGSINK_RHYTHM_MODE < FMTGSink::kRhythmModeNum, "invalid rhythm mode");
+static_assert(0 <= FMTGSINK_LATENCY_MODE && FMTGSINK_LATENCY_MODE < FMTGSink::kLatencyModeNum, "invalid latency mode");
+
+// 全チップの出力を int32 で加算して、1 ブロック分の PCM を生成する
+void FMTGSink::renderBlock(int16_t *out, int sample_num)
+{
+    if (chip_num_ == 1) {
+        OPLL_calcBlock(opll_[0], out, sample_num);
+        return;
+    }
+
+    int32_t mix[kPbMaxSampleCount];
+    OPLL_calcBlock(opll_[0], out, sample_num);
+    for (int i = 0; i < sample_num; i++) {
+        mix[i] = out[i];
+    }
+    for (int chip = 1; chip < chip_num_; chip++) {
+        OPLL_calcBlock(opll_[chip], out, sample_num);
+        for (int i = 0; i < sample_num; i++) {
+            mix[i] += out[i];
+        }
+    }
+
+    for (int i = 0; i < sample_num; i++) {
+        int32_t v = mix[i] >> mix_shift_;
+        out[i] = (v > 32767) ? 32767 : ((v < -32768) ? -32768 : v);
+    }
 }
 
-static uint32_t msToByte(int ms) {
-    return kPbBytePerSec * ms / 1000;
+// ステレオ (L, R の順) で 1 ブロック分の PCM を生成する
+void FMTGSink::renderBlockStereo(int16_t *out, int sample_num)
+{
+    if (chip_num_ == 1) {
+        OPLL_calcBlockStereo(opll_[0], out, sample_num);
+        return;
+    }
+
+    const int n = sample_num * 2;
+    int32_t mix[kPbMaxSampleCount * 2];
+    OPLL_calcBlockStereo(opll_[0], out, sample_num);
+    for (int i = 0; i < n; i++) {
+        mix[i] = out[i];
+    }
+    for (int chip = 1; chip < chip_num_; chip++) {
+        OPLL_calcBlockStereo(opll_[chip], out, sample_num);
+        for (int i = 0; i < n; i++) {
+            mix[i] += out[i];
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        int32_t v = mix[i] >> mix_shift_;
+        out[i] = (v > 32767) ? 32767 : ((v < -32768) ? -32768 : v);
+    }
 }
 
-void FMTGSink::writeToRenderer(int ch)
+void FMTGSink::dispatchEvent(const MidiEvent &event)
 {
-    while (renderer_.getWritableSize(ch) >= kPbBlockSize) {
-        size_t read_size = renderer_.getWritableSize(ch);
-        if (read_size > kPbBlockSize) {
-            read_size = kPbBlockSize;
+    const uint8_t channel = event.status & 0x0f;
+
+    switch (event.status & 0xf0) {
+    case 0x90:
+        if (event.data2 != 0) {
+            sendNoteOn(event.data1, event.data2, channel);
+        } else {
+            sendNoteOff(event.data1, event.data2, channel);
         }
+        break;
 
-        uint8_t buffer[read_size];
-        uint8_t *p = buffer;
+    case 0x80:
+        sendNoteOff(event.data1, event.data2, channel);
+        break;
 
-        for (int i = 0; i < (read_size >> 2); i++) {
-            int16_t out = OPLL_calcNoRateConv(opll_);
-            uint8_t out_L =  out & 0xff;
-            uint8_t out_H = (out & 0xff00) >> 8;
+    case 0xb0:
+        handleControlChange(event.data1, event.data2, channel);
+        break;
 
-            *p++ = out_L; // Lch
-            *p++ = out_H;
-            *p++ = out_L; // Rch
-            *p++ = out_H;
+    case 0xe0:
+        pitch_[channel].bend = (int16_t)(((event.data2 << 7) | event.data1) - 8192);
+        updatePitchOffset(channel);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void FMTGSink::resetPitch(int channel)
+{
+    ChannelPitch &p = pitch_[channel];
+    p.bend = 0;
+    p.bend_range = kDefaultBendRange;
+    p.fine_tune = 8192;
+    p.coarse_tune = 64;
+    p.rpn = kRpnNull;
+    p.offset = 0;
+}
+
+void FMTGSink::handleControlChange(uint8_t control, uint8_t value, uint8_t channel)
+{
+    ChannelPitch &p = pitch_[channel];
+
+    switch (control) {
+    case 101:  // RPN MSB
+        p.rpn = (p.rpn & 0x007f) | (value << 7);
+        break;
+
+    case 100:  // RPN LSB
+        p.rpn = (p.rpn & 0x3f80) | value;
+        break;
+
+    case 98:   // NRPN LSB
+    case 99:   // NRPN MSB
+        // NRPN には対応しないので、以降のデータエントリーは無視する
+        p.rpn = kRpnNull;
+        break;
+
+    case 6:    // Data Entry MSB
+        switch (p.rpn) {
+        case kRpnBendRange:
+            p.bend_range = (value << 7) | (p.bend_range & 0x7f);
+            break;
+        case kRpnFineTune:
+            p.fine_tune = (value << 7) | (p.fine_tune & 0x7f);
+            break;
+        case kRpnCoarseTune:
+            p.coarse_tune = value;
+            break;
+        default:
+            return;
         }
+        updatePitchOffset(channel);
+        break;
 
-        renderer_.write(ch, buffer, read_size);
+    case 38:   // Data Entry LSB
+        switch (p.rpn) {
+        case kRpnBendRange:
+            p.bend_range = (p.bend_range & 0x3f80) | value;
+            break;
+        case kRpnFineTune:
+            p.fine_tune = (p.fine_tune & 0x3f80) | value;
+            break;
+        default:
+            return;
+        }
+        updatePitchOffset(channel);
+        break;
+
+    case 10:   // Pan
+        pan_[channel] = value;
+        if (channel_count_ == 2) {
+            // 鳴っているボイス（リリース中を含む）にもすぐに反映する
+            for (int voice = 0; voice < allocator_.getVoiceNum(); voice++) {
+                if (allocator_.getNote(voice) <= 127 && allocator_.getChannel(voice) == channel) {
+                    setVoicePan(voice, value);
+                }
+            }
+        }
+        break;
+
+    case 121:  // Reset All Controllers
+        p.bend = 0;
+        p.rpn = kRpnNull;
+        updatePitchOffset(channel);
+        break;
+
+    default:
+        break;
     }
 }
 
-int FMTGSink::getPlayingChannelMap(void)
+// ピッチベンドと RPN の値から、チャンネルのピッチのずれ (1/256 半音単位) を求める
+void FMTGSink::updatePitchOffset(int channel)
+{
+    ChannelPitch &p = pitch_[channel];
+    const int32_t one = 1 << PitchTable::kFracBits;
+
+    const int32_t range = (p.bend_range >> 7) * one + (p.bend_range & 0x7f) * one / 100;
+    int32_t offset = p.bend * range / 8192;
+    offset += ((int32_t)p.fine_tune - 8192) * one / 8192;
+    offset += ((int32_t)p.coarse_tune - 64) * one;
+
+    if (offset != p.offset) {
+        p.offset = offset;
+        pitch_dirty_ |= 1 << channel;
+    }
+}
+
+// ピッチが変わったチャンネルで鳴っているボイス（リリース中を含む）の F-Number を書き換える
+// ブロック、F-Number が変わらなければレジスタには書き込まない
+void FMTGSink::flushPitch(void)
+{
+    for (int voice = 0; voice < allocator_.getVoiceNum(); voice++) {
+        const uint8_t note = allocator_.getNote(voice);
+        const uint8_t channel = allocator_.getChannel(voice);
+        if (note > 127 || !(pitch_dirty_ & (1 << channel))) {
+            continue;
+        }
+
+        const uint16_t bf = pitch_table_.getBlockFnum((note << PitchTable::kFracBits) + pitch_[channel].offset);
+        const uint16_t old_bf = voice_bf_[voice];
+        if (bf == old_bf) {
+            continue;
+        }
+        voice_bf_[voice] = bf;
+
+        const int ch = getChipCh(voice);
+        const uint8_t key = allocator_.isKeyOn(voice) ? 0x10 : 0x00;
+        uint16_t cmds[2];
+        int cmd_num = 0;
+        if ((bf & 0xff) != (old_bf & 0xff)) {
+            cmds[cmd_num++] = OPLL_REG_CMD(0x10 + ch, bf & 0xff);
+        }
+        if ((bf >> 8) != (old_bf >> 8)) {
+            cmds[cmd_num++] = OPLL_REG_CMD(0x20 + ch, key | (bf >> 8));
+        }
+        OPLL_writeRegs(getChip(voice), cmds, cmd_num);
+    }
+
+    pitch_dirty_ = 0;
+}
+
+// ボイスの OPLL のチャンネルの左右の音量を設定する
+// 中央では左右とも 1.0（モノラルと同じ音量）で、反対側だけを絞る
+void FMTGSink::setVoicePan(int voice, uint8_t pan)
+{
+    if (voice_pan_[voice] == pan) {
+        return;
+    }
+    voice_pan_[voice] = pan;
+
+    float gain[2];
+    gain[0] = (pan <= kPanCenter) ? 1.0f : (float)(127 - pan) / (127 - kPanCenter);
+    gain[1] = (pan >= kPanCenter) ? 1.0f : (float)pan / kPanCenter;
+    OPLL_setPanFine(getChip(voice), getChipCh(voice), gain);
+
+    if (pan == kPanCenter) {
+        panned_voices_ &= ~((uint64_t)1 << voice);
+    } else {
+        panned_voices_ |= (uint64_t)1 << voice;
+    }
+}
+
+// キューにたまった MIDI イベントと SMF のイベントを、時刻順にブロックの途中で反映しながら生成する
+// stereo: L, R の順のステレオで生成する（false ならモノラル）
+// queued_us: レンダラーのバッファにたまっている音の長さ（このブロックが再生されるまでの時間）
+void FMTGSink::renderBlockWithEvents(int16_t *out, int sample_num, bool stereo, uint32_t queued_us)
+{
+    const int frame = stereo ? 2 : 1;
+    // このブロックが受け持つイベント時刻は [block_time_, block_time_ + block_us)
+    // ブロックの先頭が再生される時刻からイベントの遅延を引いた時刻が、ブロックの先頭に対応する
+    // 通常はブロックごとに block_us ずつ進めるだけだが、起動直後や、バッファを続けて埋めたとき、
+    // レンダリングが滞って音が途切れたときなど、再生位置からずれた場合はどちら向きでも合わせ直す
+    const uint32_t target = micros() + queued_us - event_delay_us_;
+    const int32_t drift = (int32_t)(target - block_time_);
+    const int32_t max_drift = (int32_t)(kMaxEventDriftBlocks * block_us_);
+    if (!block_time_valid_ || drift > max_drift || drift < -max_drift) {
+        block_time_ = target;
+        block_time_valid_ = true;
+    }
+    const int32_t block_us = sample_num * 1000 / (kPbSampleFrq / 1000);
+
+    int pos = 0;
+    for (;;) {
+        // 2 つのキューのうち、時刻の早いほうのイベントから反映する（同じ時刻なら MIDI 入力が先）
+        const MidiEvent *live = event_queue_.peek();
+        const MidiEvent *smf = smf_queue_.peek();
+        MidiEventQueue *queue;
+        if (live && (!smf || (int32_t)(smf->time - live->time) >= 0)) {
+            queue = &event_queue_;
+        } else if (smf) {
+            queue = &smf_queue_;
+        } else {
+            break;
+        }
+        const MidiEvent *event = queue->peek();
+
+        const int32_t dt = (int32_t)(event->time - block_time_);
+        if (dt >= block_us) {
+            // 次のブロック以降のイベント
+            break;
+        }
+
+        // 遅れて届いたイベントはブロックの先頭で反映する
+        const int offset = (dt <= 0) ? 0 : (int)((uint32_t)dt * (kPbSampleFrq / 1000) / 1000);
+        if (offset > pos) {
+            if (pitch_dirty_) {
+                flushPitch();
+            }
+            if (stereo) {
+                renderBlockStereo(out + pos * frame, offset - pos);
+            } else {
+                renderBlock(out + pos, offset - pos);
+            }
+            pos = offset;
+        }
+
+        MidiEvent e;
+        queue->pop(&e);
+        dispatchEvent(e);
+    }
+
+    if (pitch_dirty_) {
+        flushPitch();
+    }
+    if (pos < sample_num) {
+        if (stereo) {
+            renderBlockStereo(out + pos * frame, sample_num - pos);
+        } else {
+            renderBlock(out + pos, sample_num - pos);
+        }
+    }
+
+    block_time_ += block_us;
+}
+
+#if FMTGSINK_PROFILE
+// エミュレータ内部の段階のサイクル数を、全チップの合計で 1 ブロック分として集計する
+void FMTGSink::collectEngineProfile(void)
+{
+    uint32_t total[StageProfiler::kStageNum] = {};
+#if OPLL_PROFILE
+    OPLL *chips[FMTGSINK_MAX_CHIPS + 1];
+    int chip_num = 0;
+    for (int chip = 0; chip < chip_num_; chip++) {
+        chips[chip_num++] = opll_[chip];
+    }
+    if (vgm_opll_) {
+        chips[chip_num++] = vgm_opll_;
+    }
+    for (int chip = 0; chip < chip_num; chip++) {
+        uint32_t counts[OPLL_PROFILE_STAGE_NUM];
+        OPLL_readProfile(chips[chip], counts);
+        total[StageProfiler::kStageAmpm] += counts[OPLL_PROFILE_AMPM];
+        total[StageProfiler::kStageSlots] += counts[OPLL_PROFILE_SLOTS];
+        total[StageProfiler::kStageCalc] += counts[OPLL_PROFILE_CALC];
+        total[StageProfiler::kStageMix] += counts[OPLL_PROFILE_MIX];
+    }
+#endif
+    profiler_.add(StageProfiler::kStageAmpm, total[StageProfiler::kStageAmpm]);
+    profiler_.add(StageProfiler::kStageSlots, total[StageProfiler::kStageSlots]);
+    profiler_.add(StageProfiler::kStageCalc, total[StageProfiler::kStageCalc]);
+    profiler_.add(StageProfiler::kStageMix, total[StageProfiler::kStageMix]);
+}
+#endif
+
+// モノラルのサンプルを、左右に同じ値を並べたステレオ (L, R の順の int16) に展開する
+// 2 サンプルを 32 bit でまとめて読み、それぞれを上下の 16 bit に複製する（リトルエンディアン）
+// in は out + sample_num / 2 以降を指していてもよい（out の先頭から順に書くので、読み出す前のサンプルは壊さない）
+static void expandMonoToStereo(uint32_t *out, const int16_t *in, int sample_num)
+{
+    const int pair_num = sample_num >> 1;
+    for (int i = 0; i < pair_num; i++) {
+        uint32_t v;
+        memcpy(&v, in + i * 2, sizeof(v));  // 1 命令のロードになる
+        out[0] = (v & 0x0000ffff) | (v << 16);
+        out[1] = (v & 0xffff0000) | (v >> 16);
+        out += 2;
+    }
+
+    if (sample_num & 1) {
+        const uint32_t v = (uint16_t)in[sample_num - 1];
+        *out = v | (v << 16);
+    }
+}
+
+// 生成したブロック数を返す
+int FMTGSink::writeToRenderer(int ch)
+{
+    int block_num = 0;
+
+    size_t writable;
+    while ((writable = renderer_->getWritableSize(ch)) >= (size_t)block_size_) {
+        PROFILE_START(block_start);
+
+        // エミュレータ側でブロック単位にまとめて生成する
+        // - モノラル出力: pcm_buffer_ にそのまま生成する
+        // - ステレオ出力で、パンを振ったボイスがある: pcm_buffer_ にステレオで生成する
+        // - ステレオ出力で、パンを振ったボイスがない: pcm_buffer_ の後半にモノラルで生成して、ステレオに展開する
+        //   （前から順に上書きしても、読み出す前のサンプルは壊さない）
+        const int sample_num = sample_count_;
+        const bool stereo = (channel_count_ == 2) && (panned_voices_ != 0) && !vgm_opll_;
+        const bool expand = (channel_count_ == 2) && !stereo;
+        int16_t *samples = (int16_t *)pcm_buffer_ + (expand ? kPbMaxSampleCount : 0);
+        if (vgm_opll_) {
+            // VGM の再生中に受信した MIDI イベントは捨てる
+            MidiEvent e;
+            while (event_queue_.pop(&e)) {
+            }
+            vgm_player_.render(vgm_opll_, samples, sample_num);
+        } else {
+            const size_t queued = (writable < buffer_capacity_) ? buffer_capacity_ - writable : 0;
+            const uint32_t render_start = micros();
+            renderBlockWithEvents(samples, sample_num, stereo, (uint32_t)((uint64_t)queued * 1000000 / bytes_per_sec_));
+            updateGovernor(micros() - render_start);
+        }
+#if FMTGSINK_PROFILE
+        collectEngineProfile();
+#endif
+
+        PROFILE_START(pack_start);
+        if (expand) {
+            expandMonoToStereo(pcm_buffer_, samples, sample_num);
+        }
+        PROFILE_STOP(kStagePack, pack_start);
+
+        PROFILE_START(write_start);
+        renderer_->write(ch, (const uint8_t *)pcm_buffer_, block_size_);
+        PROFILE_STOP(kStageWrite, write_start);
+        PROFILE_STOP(kStageBlock, block_start);
+        block_num++;
+    }
+
+    return block_num;
+}
+
+// 1 チップあたりの発音数の上限を変える
+// 下げるときは外すボイスをキーオフして、リリースが終わってから（updateGovernor() で）OPLL の発音数を減らす
+// 上げるときは、先に OPLL の発音数を増やしてからアロケータに割り当てさせる
+void FMTGSink::setVoiceLimit(int limit)
+{
+    limit = constrain(limit, FMTGSINK_MIN_VOICES, rhythm_on_ ? FMTGSINK_RHYTHM_VOICES : FMTGSINK_MAX_VOICES);
+    if (opll_[0] == nullptr) {
+        // begin() の前
+        voice_limit_ = limit;
+        return;
+    }
+
+    if (limit < voice_limit_) {
+        for (int voice = limit * chip_num_; voice < voice_limit_ * chip_num_; voice++) {
+            if (allocator_.isKeyOn(voice)) {
+                OPLL_writeReg(getChip(voice), 0x20 + getChipCh(voice), voice_bf_[voice] >> 8); // keyoff
+            }
+        }
+        allocator_.setVoiceLimit(limit * chip_num_);
+        voice_limit_ = limit;
+        shrink_wait_ = kShrinkWaitUs / block_us_;
+    } else if (limit > voice_limit_) {
+        if (limit >= opll_voices_) {
+            setOpllVoices(limit);
+            shrink_wait_ = 0;
+        }
+        allocator_.setVoiceLimit(limit * chip_num_);
+        voice_limit_ = limit;
+    }
+}
+
+void FMTGSink::setOpllVoices(int voices)
+{
+    const uint32_t enable_ch = (1 << voices) - 1;
+    for (int chip = 0; chip < chip_num_; chip++) {
+        const uint32_t enable_rhythm = (chip == 0 && rhythm_on_) ? OPLL_MASK_RHYTHM : 0;
+        OPLL_setVoiceNum(opll_[chip], voices);
+        OPLL_setMask(opll_[chip], ~(enable_ch | enable_rhythm));
+    }
+    opll_voices_ = voices;
+}
+
+// チャンネル limit 以降に、まだ音が残っているチャンネルがあるか
+bool FMTGSink::isReleasing(int limit)
+{
+    const uint32_t mask = ((1 << opll_voices_) - 1) & ~((1 << limit) - 1);
+    for (int chip = 0; chip < chip_num_; chip++) {
+        if (OPLL_getActiveMask(opll_[chip]) & mask) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 1 ブロックの生成にかかった時間を CpuGovernor に渡して、発音数の上限を調整する
+void FMTGSink::updateGovernor(uint32_t render_us)
+{
+    const uint32_t enable_ch = (1 << opll_voices_) - 1;
+    int active = 0;
+    for (int chip = 0; chip < chip_num_; chip++) {
+        active += __builtin_popcount(OPLL_getActiveMask(opll_[chip]) & enable_ch);
+    }
+    if (rhythm_on_) {
+        // リズム音のスロットは、鳴っていなくても毎サンプル更新している
+        active += CpuGovernor::kRhythmCost;
+    }
+
+    if (governor_.update(render_us, active)) {
+        setVoiceLimit(governor_.getVoiceLimit() / chip_num_);
+    }
+    if (rhythm_on_ && rhythm_mode_ == kRhythmAuto && !governor_.isRhythmAllowed()) {
+        setRhythm(false);
+    }
+
+    if (shrink_wait_ > 0) {
+        if (!isReleasing(voice_limit_) || --shrink_wait_ == 0) {
+            setOpllVoices(voice_limit_);
+            shrink_wait_ = 0;
+        }
+    }
+}
+
+// チップ 0 のリズムモードを切り替える
+// 使い始めるときは、チャンネル 7 - 9 で鳴っているボイスを止めて、リズム音のピッチと音量を設定する
+void FMTGSink::setRhythm(bool on)
+{
+    if (on == rhythm_on_ || opll_[0] == nullptr) {
+        return;
+    }
+    rhythm_on_ = on;
+    rhythm_keys_ = 0;
+    clearRhythmNotes();
+    governor_.setRhythm(on, chip_num_ * FMTGSINK_RHYTHM_VOICES);
+
+    if (on) {
+        if (voice_limit_ > FMTGSINK_RHYTHM_VOICES) {
+            setVoiceLimit(FMTGSINK_RHYTHM_VOICES);
+        }
+        // リリース中の音も待たずに止める（リズム音のマスクも外す）
+        setOpllVoices((opll_voices_ < FMTGSINK_RHYTHM_VOICES) ? opll_voices_ : FMTGSINK_RHYTHM_VOICES);
+        if (shrink_wait_ > 0 && opll_voices_ == voice_limit_) {
+            shrink_wait_ = 0;
+        }
+
+        // BD: チャンネル 7、HH, SD: チャンネル 8、TOM, CYM: チャンネル 9 のブロックと F-Number
+        const uint16_t cmds[] = {
+            OPLL_REG_CMD(0x16, 0x20), OPLL_REG_CMD(0x26, 0x05),
+            OPLL_REG_CMD(0x17, 0x50), OPLL_REG_CMD(0x27, 0x05),
+            OPLL_REG_CMD(0x18, 0xc0), OPLL_REG_CMD(0x28, 0x01),
+            OPLL_REG_CMD(0x36, rhythm_vol_[0]),
+            OPLL_REG_CMD(0x37, rhythm_vol_[1]),
+            OPLL_REG_CMD(0x38, rhythm_vol_[2]),
+            OPLL_REG_CMD(0x0e, 0x20),
+        };
+        OPLL_writeRegs(opll_[0], cmds, sizeof(cmds) / sizeof(cmds[0]));
+    } else {
+        OPLL_writeReg(opll_[0], 0x0e, 0x00);
+        setOpllVoices(opll_voices_);
+        if (governor_.isEnabled()) {
+            // リズムモードの間に抑えていた分を戻す
+            setVoiceLimit(governor_.getVoiceLimit() / chip_num_);
+        }
+    }
+}
+
+// GM ドラムのノートを、近いリズム音 (レジスタ 0x0e のビット) に割り当てる。割り当てがなければ 0
+static uint8_t getDrumKey(uint8_t note)
+{
+    switch (note) {
+    case 35: case 36:                                        // Bass Drum
+        return kRhythmBD;
+    case 37: case 38: case 39: case 40:                      // Side Stick, Snare, Hand Clap
+        return kRhythmSD;
+    case 41: case 43: case 45: case 47: case 48: case 50:    // Tom
+        return kRhythmTOM;
+    case 42: case 44: case 46: case 54:                      // Hi-Hat, Tambourine
+        return kRhythmHH;
+    case 49: case 51: case 52: case 53: case 55: case 56: case 57: case 59:  // Cymbal, Cowbell
+        return kRhythmCYM;
+    default:
+        return 0;
+    }
+}
+
+// MIDI チャンネル 10 のノートをリズム音で鳴らせるか。kRhythmAuto で余裕があれば、ここでリズムモードを使い始める
+// 鳴らせなければ、ほかのチャンネルと同じくメロディの音色で鳴らす
+bool FMTGSink::prepareRhythm(void)
+{
+    if (rhythm_on_) {
+        return true;
+    }
+    if (rhythm_mode_ != kRhythmAuto || !governor_.isEnabled() || !governor_.isRhythmAllowed()) {
+        return false;
+    }
+    setRhythm(true);
+    return rhythm_on_;
+}
+
+void FMTGSink::clearRhythmNotes(void)
+{
+    for (int i = 0; i < 4; i++) {
+        rhythm_notes_[i] = 0;
+    }
+}
+
+// MIDI チャンネル 10 のノートをリズム音で鳴らす (prepareRhythm() が true のときだけ呼ぶ)
+// リズム音はキーオフしなくても減衰するので、ノートオフは無視して、次のノートオンで鳴らし直す
+bool FMTGSink::sendDrumOn(uint8_t note, uint8_t velocity)
+{
+    const uint8_t key = getDrumKey(note);
+    if (key == 0) {
+        return false;
+    }
+
+    // 音量は BD: 0x36 の下位、HH: 0x37 の上位、SD: 0x37 の下位、TOM: 0x38 の上位、CYM: 0x38 の下位 4 bit
+    const uint8_t vol = (0x0f - (velocity >> 3)) & 0x0f;
+    int index;
+    bool high;
+    switch (key) {
+    case kRhythmBD:  index = 0; high = false; break;
+    case kRhythmHH:  index = 1; high = true;  break;
+    case kRhythmSD:  index = 1; high = false; break;
+    case kRhythmTOM: index = 2; high = true;  break;
+    default:         index = 2; high = false; break;  // kRhythmCYM
+    }
+    rhythm_vol_[index] = high ? ((rhythm_vol_[index] & 0x0f) | (vol << 4)) : ((rhythm_vol_[index] & 0xf0) | vol);
+
+    // キーオフしてからキーオンし直して、鳴っている途中でもアタックからやり直す
+    const uint16_t cmds[] = {
+        OPLL_REG_CMD(0x36 + index, rhythm_vol_[index]),
+        OPLL_REG_CMD(0x0e, 0x20 | (rhythm_keys_ & ~key)),
+        OPLL_REG_CMD(0x0e, 0x20 | rhythm_keys_ | key),
+    };
+    OPLL_writeRegs(opll_[0], cmds, sizeof(cmds) / sizeof(cmds[0]));
+    rhythm_keys_ |= key;
+    rhythm_notes_[note >> 5] |= 1UL << (note & 31);
+
+    return true;
+}
+
+// レイテンシーのモードから、ブロックの大きさと理論上のレイテンシーを求める（レンダラーは begin() で作る）
+void FMTGSink::setLatencyMode(int mode)
+{
+    const LatencyConfig &config = kLatencyConfigs[mode];
+    latency_mode_ = mode;
+    sample_count_ = config.sample_count;
+    block_size_ = sample_count_ * (kPbBitDepth / 8) * channel_count_;
+    block_us_ = (uint32_t)sample_count_ * 1000000 / kPbSampleFrq;
+    bytes_per_sec_ = kPbSampleFrq * (kPbBitDepth / 8) * channel_count_;
+
+    // ブロックは、バッファに 1 ブロック分の空きができたとき（まだ最大でバッファ - 1 ブロック分の音が残っているとき）に生成する
+    // そのブロックの間に受信するイベントがすべて揃ってから生成するには、1 ブロック + 残っている音の長さ、
+    // つまりバッファの長さだけ遅らせる必要がある
+    event_delay_us_ = block_us_ + (uint32_t)((uint64_t)(config.cache_frame_num - sample_count_) * 1000000 / kPbSampleFrq);
+
+    // イベントの遅延（バッファにたまっている音を含む）+ 先読みしたブロック
+    latency_us_ = event_delay_us_ + config.preload_frame_num * block_us_;
+}
+
+void FMTGSink::resetTelemetry(void)
 {
-    int map = 0;
+    telemetry_.update_count = 0;
+    telemetry_.block_count = 0;
+    telemetry_.max_blocks = 0;
+    telemetry_.low_water_us = UINT32_MAX;
+    telemetry_.underrun_count = 0;
+    telemetry_.max_interval_us = 0;
+}
 
-    for (auto it = keyOnLog_.begin(); it != keyOnLog_.end(); ++it) {
-        map |= 1 << (*it);
+// 書き込む前のバッファの残量と、前回の update() からの間隔を記録する
+// バッファが空になっていれば、その間にレンダラーに渡す音が途切れた（クリックノイズの原因）とみなす
+void FMTGSink::checkBuffer(int ch)
+{
+    const uint32_t now = micros();
+    if (last_update_valid_) {
+        const uint32_t interval = now - last_update_;
+        if (interval > telemetry_.max_interval_us) {
+            telemetry_.max_interval_us = interval;
+        }
+    }
+    last_update_ = now;
+    last_update_valid_ = true;
+
+    const size_t writable = renderer_->getWritableSize(ch);
+    const size_t filled = (writable < buffer_capacity_) ? buffer_capacity_ - writable : 0;
+    const uint32_t filled_us = (uint32_t)((uint64_t)filled * 1000000 / bytes_per_sec_);
+    if (filled_us < telemetry_.low_water_us) {
+        telemetry_.low_water_us = filled_us;
     }
 
-    return map;
+    if (filled == 0) {
+        if (!underrun_) {
+            telemetry_.underrun_count++;
+        }
+        underrun_ = true;
+    } else {
+        underrun_ = false;
+    }
+
+    telemetry_.update_count++;
+}
+
+bool FMTGSink::startVgm(const char *path)
+{
+    stopVgm();
+    stopSmf(true);
+
+    if (!vgm_source_.open(path)) {
+        return false;
+    }
+
+    // YM2413 のコマンドがないファイルは再生しない
+    if (!vgm_player_.begin(&vgm_source_, kPbSampleFrq) || vgm_player_.getClock() == 0) {
+        vgm_source_.close();
+        return false;
+    }
+
+    // VGM はヘッダに書かれたクロックで鳴らす（kOpllClk と異なる場合はレートコンバータを使う）
+    vgm_opll_ = OPLL_new(vgm_player_.getClock(), kPbSampleFrq);
+    if (vgm_opll_ == nullptr) {
+        vgm_player_.end();
+        vgm_source_.close();
+        return false;
+    }
+    OPLL_setVoiceNum(vgm_opll_, FMTGSINK_VGM_VOICES);
+    OPLL_setAutoIdle(vgm_opll_, 1);
+
+    // 最初のデータはここで読み込んでおく（以降は update() で先読みする）
+    vgm_source_.prefetch();
+    vgm_source_.prefetch();
+
+    return true;
+}
+
+void FMTGSink::stopVgm(void)
+{
+    if (vgm_opll_) {
+        OPLL_delete(vgm_opll_);
+        vgm_opll_ = nullptr;
+    }
+    vgm_player_.end();
+    vgm_source_.close();
+}
+
+bool FMTGSink::startSmf(const char *path)
+{
+    stopSmf(true);
+    stopVgm();
+
+    if (!smf_source_.open(path)) {
+        return false;
+    }
+    if (!smf_sequencer_.begin(&smf_source_)) {
+        smf_source_.close();
+        return false;
+    }
+
+    smf_start_ = micros() + FMTGSINK_SMF_LOOKAHEAD_US;
+    smf_playing_ = true;
+    feedSmf();
+
+    return true;
+}
+
+// cut: キューに入れたイベントを捨てて、鳴っている音を止める
+void FMTGSink::stopSmf(bool cut)
+{
+    if (!smf_playing_) {
+        return;
+    }
+
+    smf_playing_ = false;
+    smf_sequencer_.end();
+    smf_source_.close();
+
+    if (cut) {
+        MidiEvent e;
+        while (smf_queue_.pop(&e)) {
+        }
+        allNotesOff();
+    }
+}
+
+// 発音時刻が FMTGSINK_SMF_LOOKAHEAD_US 先までのイベントをキューに入れる
+// レンダリングの際に、MIDI 入力と同じくブロックの中のサンプル単位の位置で反映される
+void FMTGSink::feedSmf(void)
+{
+    const uint32_t horizon = micros() + FMTGSINK_SMF_LOOKAHEAD_US;
+
+    const SmfEvent *event;
+    while ((event = smf_sequencer_.peek()) != nullptr) {
+        const uint32_t time = smf_start_ + event->time;
+        if ((int32_t)(time - horizon) > 0 || smf_queue_.isFull()) {
+            // キューが満杯なら、続きは次の update() で入れる
+            return;
+        }
+        smf_queue_.push(time, event->status, event->data1, event->data2);
+
+        SmfEvent e;
+        smf_sequencer_.pop(&e);
+    }
+
+    // 最後のイベントまでキューに入れたら終わり（鳴っている音はそのまま）
+    stopSmf(false);
+}
+
+void FMTGSink::allNotesOff(void)
+{
+    for (int voice = 0; voice < allocator_.getVoiceNum(); voice++) {
+        if (allocator_.isKeyOn(voice)) {
+            sendNoteOff(allocator_.getNote(voice), 0, allocator_.getChannel(voice));
+        }
+    }
+    if (rhythm_on_ && rhythm_keys_) {
+        rhythm_keys_ = 0;
+        OPLL_writeReg(opll_[0], 0x0e, 0x20);
+    }
+    clearRhythmNotes();
+}
+
+int FMTGSink::getPlayingChannelMap(void)
+{
+    return (int)allocator_.getKeyOnMap();
+}
+
+// キャリアの減衰量（エンベロープ + トータルレベル）が小さいほど音量が大きい
+int FMTGSink::getVoiceLevel(int voice, void *context) {
+    FMTGSink *sink = (FMTGSink *)context;
+    OPLL *opll = sink->getChip(voice);
+    int slot = sink->getChipCh(voice) * 2 + 1;
+    return -(opll->lanes.eg_out[slot] + opll->lanes.tll[slot]);
 }
 
 FMTGSink::FMTGSink() : NullFilter(),
-    renderer_(kPbSampleFrq, kPbBitDepth, kPbChannelCount, kPbSampleCount, kPbCacheSize, 1) {
-    for (int i = 0; i < FMTGSINK_MAX_VOICES; i++) {
-        voices_[i].noteNo = INVALID_NOTE_NUMBER;
+    chip_num_(FMTGSINK_DEFAULT_CHIPS), mix_shift_(0), volume_(0), pitch_dirty_(0), panned_voices_(0),
+    renderer_(nullptr), block_time_(0), block_time_valid_(false),
+    vgm_opll_(nullptr), smf_playing_(false), smf_start_(0),
+    channel_count_(FMTGSINK_OUTPUT_CHANNELS), buffer_capacity_(0), underrun_(false), last_update_(0), last_update_valid_(false),
+    voice_limit_(FMTGSINK_DEFAULT_VOICES), opll_voices_(FMTGSINK_DEFAULT_VOICES), shrink_wait_(0),
+    rhythm_mode_(FMTGSINK_RHYTHM_MODE), rhythm_on_(false), rhythm_keys_(0) {
+    for (int chip = 0; chip < FMTGSINK_MAX_CHIPS; chip++) {
+        opll_[chip] = nullptr;
     }
+    allocator_.setLevelFunc(getVoiceLevel, this);
+    governor_.setEnabled(FMTGSINK_GOVERNOR);
+    setLatencyMode(FMTGSINK_LATENCY_MODE);
+    resetTelemetry();
 
     for (int ch = 0; ch < 16; ch++) {
         inst_[ch] = kDefaultInstNo;
+        pan_[ch] = kPanCenter;
+        resetPitch(ch);
     }
+    for (int voice = 0; voice < FMTGSINK_MAX_CHIPS * FMTGSINK_MAX_VOICES; voice++) {
+        voice_bf_[voice] = 0;
+        voice_pan_[voice] = kPanCenter;
+    }
+    for (int i = 0; i < 3; i++) {
+        rhythm_vol_[i] = 0x00;
+    }
+    clearRhythmNotes();
+
+    // 128 ノート分のブロックと F-Number はここで一度だけ計算する
+    pitch_table_.init(kFnumA4);
 }
 
 FMTGSink::~FMTGSink() {
+    stopVgm();
+    stopSmf(false);
+    delete renderer_;
+    for (int chip = 0; chip < FMTGSINK_MAX_CHIPS; chip++) {
+        if (opll_[chip]) {
+            OPLL_delete(opll_[chip]);
+        }
+    }
 }
 
 bool FMTGSink::begin() {
     bool ok = true;
 
-    opll_ = OPLL_new(kOpllClk, kPbSampleFrq);
-    OPLL_setVoiceNum(opll_, FMTGSINK_MAX_VOICES);
+    for (int chip = 0; chip < chip_num_; chip++) {
+        opll_[chip] = OPLL_new(kOpllClk, kPbSampleFrq);
+        if (opll_[chip] == nullptr) {
+            return false;
+        }
+        OPLL_setAutoIdle(opll_[chip], 1);
+    }
+    setOpllVoices(voice_limit_);
+    shrink_wait_ = 0;
+    rhythm_on_ = false;
+
+    // ボイス v はチップ v % chip_num_ のチャンネル v / chip_num_ に割り当てる
+    // 上限まで増やせるようにボイスを用意しておき、そのうち voice_limit_ 音分だけを使う
+    allocator_.reset(chip_num_ * FMTGSINK_MAX_VOICES, chip_num_);
+    allocator_.setVoiceLimit(chip_num_ * voice_limit_);
+    governor_.reset(chip_num_ * FMTGSINK_MIN_VOICES, chip_num_ * FMTGSINK_MAX_VOICES, chip_num_,
+                    chip_num_ * voice_limit_, block_us_);
+    if (rhythm_mode_ == kRhythmOn) {
+        setRhythm(true);
+    }
 
-    int enable_ch = 0;
-    for (int i = 0; i < FMTGSINK_MAX_VOICES; i++) {
-        enable_ch |= 1 << i;
+    // 合計の発音数が 1 チップ (9 音) を超える分だけ、加算時にヘッドルームを確保する
+    // CpuGovernor が上限まで増やしてもクリップしないように、上限 (FMTGSINK_MAX_VOICES) で決める
+    // （途中で変えると音量が変わってしまうので、発音数の上限に合わせて変えることはしない）
+    mix_shift_ = 0;
+    while ((9 << mix_shift_) < chip_num_ * FMTGSINK_MAX_VOICES) {
+        mix_shift_++;
     }
-    OPLL_setMask(opll_, ~enable_ch);
+
+#if FMTGSINK_PROFILE
+    profiler_.begin((uint64_t)F_CPU * sample_count_ / kPbSampleFrq);  // 1 ブロックの時間 (サイクル数)
+#if OPLL_PROFILE
+    OPLL_setProfileCounter(StageProfiler::now);
+#endif
+#endif
 
     // setup renderer
-    renderer_.begin();
-    renderer_.clear(0);
+    const LatencyConfig &config = kLatencyConfigs[latency_mode_];
+    const size_t cache_size = config.cache_frame_num * (kPbBitDepth / 8) * channel_count_;
+    renderer_ = new PcmRenderer(kPbSampleFrq, kPbBitDepth, channel_count_, sample_count_, cache_size, 1);
+    if (renderer_ == nullptr) {
+        return false;
+    }
+    renderer_->begin();
+    renderer_->clear(0);
+    renderer_->setVolume(volume_, 0, 0);
+
+    // 空のときに書き込める大きさが、バッファの大きさ
+    buffer_capacity_ = renderer_->getWritableSize(0);
+    resetTelemetry();
+    underrun_ = false;
+    last_update_valid_ = false;
 
     // preload sound
-    for (int i = 0; i < kPreloadFrameNum; i++) {
-        if (!renderer_.render()) {
+    for (int i = 0; i < config.preload_frame_num; i++) {
+        if (!renderer_->render()) {
             break;
         }
     }
 
-    renderer_.setState(PcmRenderer::kStateActive);
+    renderer_->setState(PcmRenderer::kStateActive);
 
     return ok;
 }
 
 void FMTGSink::update() {
-    switch (renderer_.getState()) {
+    if (renderer_ == nullptr) {
+        return;
+    }
+
+    switch (renderer_->getState()) {
         case PcmRenderer::kStateReady:
             break;
-        case PcmRenderer::kStateActive:
-            writeToRenderer(0);
+        case PcmRenderer::kStateActive: {
+            checkBuffer(0);
+            const uint32_t block_num = writeToRenderer(0);
+            telemetry_.block_count += block_num;
+            if (block_num > telemetry_.max_blocks) {
+                telemetry_.max_blocks = block_num;
+            }
             break;
+        }
         case PcmRenderer::kStatePause:
             break;
         default:
             break;
     }
+
+    // SD カードからの読み込みは、レンダリングが済んだこのタイミングで行う
+    if (smf_playing_) {
+        feedSmf();
+    }
+    if (vgm_opll_) {
+        vgm_source_.prefetch();
+        if (vgm_player_.isFinished()) {
+            stopVgm();
+        }
+    }
 }
 
 bool FMTGSink::isAvailable(int param_id) {
+#if FMTGSINK_PROFILE
+    if (FMTGSink::PARAMID_PROFILE_COUNT <= param_id && param_id < FMTGSink::PARAMID_PROFILE_HIST + kProfileHistNum) {
+        return true;
+    }
+#endif
+
     switch (param_id) {
     case FMTGSink::PARAMID_INST:
         return true;
@@ -144,6 +1058,49 @@ bool FMTGSink::isAvailable(int param_id) {
     case FMTGSink::PARAMID_PLAYING_CH_MAP:
         return true;
 
+    case FMTGSink::PARAMID_VOICE_POLICY:
+        return true;
+
+    case FMTGSink::PARAMID_CHIP_NUM:
+        return true;
+
+    case FMTGSink::PARAMID_VGM_FILE:
+        return true;
+
+    case FMTGSink::PARAMID_SMF_FILE:
+        return true;
+
+    case FMTGSink::PARAMID_UPDATE_COUNT:
+    case FMTGSink::PARAMID_BLOCK_COUNT:
+    case FMTGSink::PARAMID_MAX_BLOCKS_PER_UPDATE:
+    case FMTGSink::PARAMID_BUFFER_LOW_WATER_US:
+    case FMTGSink::PARAMID_UNDERRUN_COUNT:
+    case FMTGSink::PARAMID_MAX_UPDATE_INTERVAL_US:
+        return true;
+
+    case FMTGSink::PARAMID_GOVERNOR:
+    case FMTGSink::PARAMID_VOICE_LIMIT:
+    case FMTGSink::PARAMID_RHYTHM_ALLOWED:
+    case FMTGSink::PARAMID_FIXED_COST_US:
+    case FMTGSink::PARAMID_VOICE_COST_US:
+        return true;
+
+    case FMTGSink::PARAMID_LATENCY_MODE:
+    case FMTGSink::PARAMID_LATENCY_US:
+    case FMTGSink::PARAMID_BLOCK_SAMPLES:
+        return true;
+
+    case FMTGSink::PARAMID_OUTPUT_CHANNELS:
+        return true;
+
+    case FMTGSink::PARAMID_RHYTHM_MODE:
+    case FMTGSink::PARAMID_RHYTHM_ON:
+    case FMTGSink::PARAMID_SMF_DROPPED_TRACKS:
+        return true;
+
+    case MidiEventQueue::PARAMID_EVENT_QUEUE:
+        return true;
+
     case Filter::PARAMID_OUTPUT_LEVEL:
         return true;
 
@@ -158,6 +1115,17 @@ intptr_t FMTGSink::getParam(int param_id) {
     if (FMTGSink::PARAMID_INST <= param_id && param_id <= FMTGSink::PARAMID_INST + 15) {
         int ch = param_id - FMTGSink::PARAMID_INST;
         return inst_[ch];
+#if FMTGSINK_PROFILE
+    } else if (FMTGSink::PARAMID_PROFILE_MIN <= param_id && param_id < FMTGSink::PARAMID_PROFILE_AVG) {
+        return profiler_.getMin(param_id - FMTGSink::PARAMID_PROFILE_MIN);
+    } else if (FMTGSink::PARAMID_PROFILE_AVG <= param_id && param_id < FMTGSink::PARAMID_PROFILE_MAX) {
+        return profiler_.getAvg(param_id - FMTGSink::PARAMID_PROFILE_AVG);
+    } else if (FMTGSink::PARAMID_PROFILE_MAX <= param_id && param_id < FMTGSink::PARAMID_PROFILE_HIST) {
+        return profiler_.getMax(param_id - FMTGSink::PARAMID_PROFILE_MAX);
+    } else if (FMTGSink::PARAMID_PROFILE_HIST <= param_id && param_id < FMTGSink::PARAMID_PROFILE_HIST + kProfileHistNum) {
+        const int index = param_id - FMTGSink::PARAMID_PROFILE_HIST;
+        return profiler_.getHist(index / StageProfiler::kHistBins, index % StageProfiler::kHistBins);
+#endif
     } else {
         switch (param_id) {
         case FMTGSink::PARAMID_INST:
@@ -166,6 +1134,84 @@ intptr_t FMTGSink::getParam(int param_id) {
         case FMTGSink::PARAMID_PLAYING_CH_MAP:
             return getPlayingChannelMap();
 
+        case FMTGSink::PARAMID_VOICE_POLICY:
+            return allocator_.getPolicy();
+
+        case FMTGSink::PARAMID_CHIP_NUM:
+            return chip_num_;
+
+        case FMTGSink::PARAMID_VGM_FILE:
+            return vgm_opll_ != nullptr;
+
+        case FMTGSink::PARAMID_SMF_FILE:
+            return smf_playing_;
+
+        case FMTGSink::PARAMID_UPDATE_COUNT:
+            return telemetry_.update_count;
+
+        case FMTGSink::PARAMID_BLOCK_COUNT:
+            return telemetry_.block_count;
+
+        case FMTGSink::PARAMID_MAX_BLOCKS_PER_UPDATE:
+            return telemetry_.max_blocks;
+
+        case FMTGSink::PARAMID_BUFFER_LOW_WATER_US:
+            // まだ記録がなければ 0
+            return (telemetry_.update_count > 0) ? telemetry_.low_water_us : 0;
+
+        case FMTGSink::PARAMID_UNDERRUN_COUNT:
+            return telemetry_.underrun_count;
+
+        case FMTGSink::PARAMID_MAX_UPDATE_INTERVAL_US:
+            return telemetry_.max_interval_us;
+
+        case FMTGSink::PARAMID_GOVERNOR:
+            return governor_.isEnabled();
+
+        case FMTGSink::PARAMID_VOICE_LIMIT:
+            return voice_limit_;
+
+        case FMTGSink::PARAMID_RHYTHM_ALLOWED:
+            return governor_.isEnabled() && governor_.isRhythmAllowed();
+
+        case FMTGSink::PARAMID_FIXED_COST_US:
+            return governor_.getFixedCost();
+
+        case FMTGSink::PARAMID_VOICE_COST_US:
+            return governor_.getVoiceCost();
+
+        case FMTGSink::PARAMID_LATENCY_MODE:
+            return latency_mode_;
+
+        case FMTGSink::PARAMID_LATENCY_US:
+            return latency_us_;
+
+        case FMTGSink::PARAMID_BLOCK_SAMPLES:
+            return sample_count_;
+
+        case FMTGSink::PARAMID_OUTPUT_CHANNELS:
+            return channel_count_;
+
+        case FMTGSink::PARAMID_RHYTHM_MODE:
+            return rhythm_mode_;
+
+        case FMTGSink::PARAMID_RHYTHM_ON:
+            return rhythm_on_;
+
+        case FMTGSink::PARAMID_SMF_DROPPED_TRACKS:
+            return smf_sequencer_.getDroppedTrackNum();
+
+#if FMTGSINK_PROFILE
+        case FMTGSink::PARAMID_PROFILE_COUNT:
+            return profiler_.getCount(StageProfiler::kStageBlock);
+
+        case FMTGSink::PARAMID_PROFILE_BUDGET:
+            return profiler_.getBudget();
+#endif
+
+        case MidiEventQueue::PARAMID_EVENT_QUEUE:
+            return (intptr_t)&event_queue_;
+
         case Filter::PARAMID_OUTPUT_LEVEL:
             return volume_;
         
@@ -194,9 +1240,121 @@ bool FMTGSink::setParam(int param_id, intptr_t value) {
             // read-only
             break;
 
+        case FMTGSink::PARAMID_VOICE_POLICY:
+            return allocator_.setPolicy(value);
+
+        case FMTGSink::PARAMID_CHIP_NUM:
+            // begin() の後には変更できない
+            if (opll_[0] != nullptr || value < 1 || FMTGSINK_MAX_CHIPS < value) {
+                return false;
+            }
+            chip_num_ = value;
+            return true;
+
+        case FMTGSink::PARAMID_VGM_FILE:
+            if (value == 0) {
+                stopVgm();
+                return true;
+            }
+            return startVgm((const char *)value);
+
+        case FMTGSink::PARAMID_SMF_FILE:
+            if (value == 0) {
+                stopSmf(true);
+                return true;
+            }
+            return startSmf((const char *)value);
+
+        case FMTGSink::PARAMID_UPDATE_COUNT:
+            if (value != 0) {
+                return false;
+            }
+            resetTelemetry();
+            return true;
+
+        case FMTGSink::PARAMID_BLOCK_COUNT:
+        case FMTGSink::PARAMID_MAX_BLOCKS_PER_UPDATE:
+        case FMTGSink::PARAMID_BUFFER_LOW_WATER_US:
+        case FMTGSink::PARAMID_UNDERRUN_COUNT:
+        case FMTGSink::PARAMID_MAX_UPDATE_INTERVAL_US:
+            // read-only
+            break;
+
+        case FMTGSink::PARAMID_GOVERNOR:
+            // 有効にしたら、今の上限から調整を始める
+            governor_.setVoiceLimit(chip_num_ * voice_limit_);
+            governor_.setEnabled(value != 0);
+            return true;
+
+        case FMTGSink::PARAMID_VOICE_LIMIT:
+            if (governor_.isEnabled() || value < FMTGSINK_MIN_VOICES || FMTGSINK_MAX_VOICES < value) {
+                return false;
+            }
+            setVoiceLimit(value);
+            return true;
+
+        case FMTGSink::PARAMID_RHYTHM_ALLOWED:
+        case FMTGSink::PARAMID_FIXED_COST_US:
+        case FMTGSink::PARAMID_VOICE_COST_US:
+            // read-only
+            break;
+
+        case FMTGSink::PARAMID_LATENCY_MODE:
+            // begin() の後には変更できない
+            if (renderer_ != nullptr || value < 0 || kLatencyModeNum <= value) {
+                return false;
+            }
+            setLatencyMode(value);
+            return true;
+
+        case FMTGSink::PARAMID_LATENCY_US:
+        case FMTGSink::PARAMID_BLOCK_SAMPLES:
+            // read-only
+            break;
+
+        case FMTGSink::PARAMID_OUTPUT_CHANNELS:
+            // begin() の後には変更できない
+            if (renderer_ != nullptr || (value != 1 && value != 2)) {
+                return false;
+            }
+            channel_count_ = value;
+            setLatencyMode(latency_mode_);
+            return true;
+
+        case FMTGSink::PARAMID_RHYTHM_MODE:
+            if (value < 0 || kRhythmModeNum <= value) {
+                return false;
+            }
+            rhythm_mode_ = value;
+            // kRhythmAuto は、使い始めるのは次のノートオンで、やめるのは CpuGovernor の判断による
+            if (value != kRhythmAuto) {
+                setRhythm(value == kRhythmOn);
+            }
+            return true;
+
+        case FMTGSink::PARAMID_RHYTHM_ON:
+        case FMTGSink::PARAMID_SMF_DROPPED_TRACKS:
+            // read-only
+            break;
+
+#if FMTGSINK_PROFILE
+        case FMTGSink::PARAMID_PROFILE_COUNT:
+            if (value != 0) {
+                return false;
+            }
+            profiler_.reset();
+            return true;
+#endif
+
+        case MidiEventQueue::PARAMID_EVENT_QUEUE:
+            // read-only
+            break;
+
         case Filter::PARAMID_OUTPUT_LEVEL:
             volume_ = constrain(value, kVolumeMin, kVolumeMax);
-            renderer_.setVolume(volume_, 0, 0);
+            if (renderer_) {
+                renderer_->setVolume(volume_, 0, 0);
+            }
             return true;
         
         default:
@@ -208,89 +1366,65 @@ bool FMTGSink::setParam(int param_id, intptr_t value) {
 }
 
 
-// F-number calculation come from SynthDriver.cpp in keijiro/vst2413
-// https://github.com/keijiro/vst2413/blob/master/source/SynthDriver.cpp
-
-static int CalculateFNumber(int note, float tune) {
-    int intervalFromA = (note - 9) % 12;
-    return kFnumA4 * powf(2.0f, (1.0f / 12) * (intervalFromA + tune));
-}
-
-static int Clamp(int value, int min, int max)
-{
-    return value < min ? min : (value > max ? max : value);
-}
-
-static int NoteToBlock(int note) {
-    return Clamp((note - 9) / 12, 0, 7);
-}
-
-static int CalculateBlockAndFNumber(int note) {
-    return (NoteToBlock(note) << 9) + CalculateFNumber(note, 0);
-}
-
 bool FMTGSink::sendNoteOn(uint8_t note, uint8_t velocity, uint8_t channel) {
     if (note > 127 || velocity > 127 || channel > 15) {
         return false;
     }
 
-    // 空いているチャンネルを探す
-    int ch = 0;
-    for (ch = 0; ch < FMTGSINK_MAX_VOICES; ch++) {
-        if (voices_[ch].noteNo == INVALID_NOTE_NUMBER) {
-            break;
-        }
+    if (channel == kDrumChannel && prepareRhythm()) {
+        return sendDrumOn(note, velocity);
     }
 
-    if (ch == FMTGSINK_MAX_VOICES) {
-        // 空いているチャンネルがなかったため、一番古い KeyOn を乗っ取る（後着優先）
-        ch = keyOnLog_[0];
-        keyOnLog_.erase(keyOnLog_.begin());
-
-        OPLL_writeReg(opll_, 0x20 + ch, 0x00); // keyoff
+    // 発音チャンネルを割り当てる（空きがなければ、ポリシーに従って乗っ取る）
+    bool steal;
+    int voice = allocator_.noteOn(note, channel, &steal);
+    if (voice == VoiceAllocator::kInvalidVoice) {
+        return false;
     }
 
-    voices_[ch].noteNo = note;
-    voices_[ch].channel = channel;
-    keyOnLog_.push_back(ch);
+    int ch = getChipCh(voice);
+    uint16_t cmds[4];
+    int cmd_num = 0;
+    if (steal) {
+        cmds[cmd_num++] = OPLL_REG_CMD(0x20 + ch, 0x00); // keyoff
+    }
 
     if (NOTE_NUMBER_MIN <= note && note <= NOTE_NUMBER_MAX) {
-        int bf = CalculateBlockAndFNumber(note);
+        int bf = pitch_table_.getBlockFnum((note << PitchTable::kFracBits) + pitch_[channel].offset);
+        voice_bf_[voice] = bf;
         uint8_t vol = 0x0f - (velocity >> 3) & 0x0f;
         uint8_t inst = (uint8_t)inst_[channel] << 4;
-        OPLL_writeReg(opll_, 0x30 + ch, inst | vol);       /* set inst# and volume. */
-        OPLL_writeReg(opll_, 0x10 + ch, bf & 0xFF);        /* set F-Number(L). */
-        OPLL_writeReg(opll_, 0x20 + ch, 0x10 + (bf >> 8)); /* set BLK & F-Number(H) and keyon. */
+        cmds[cmd_num++] = OPLL_REG_CMD(0x30 + ch, inst | vol);       /* set inst# and volume. */
+        cmds[cmd_num++] = OPLL_REG_CMD(0x10 + ch, bf & 0xFF);        /* set F-Number(L). */
+        cmds[cmd_num++] = OPLL_REG_CMD(0x20 + ch, 0x10 + (bf >> 8)); /* set BLK & F-Number(H) and keyon. */
+    }
+
+    if (channel_count_ == 2) {
+        setVoicePan(voice, pan_[channel]);
     }
 
+    // まとめて書き込むことで、キーオン／オフの状態の更新を 1 回で済ませる
+    OPLL_writeRegs(getChip(voice), cmds, cmd_num);
+
     return true;
 }
 
 bool FMTGSink::sendNoteOff(uint8_t note, uint8_t velocity, uint8_t channel) {
-    // Note Off すべきチャンネルをスキャン
-    int ch = 0;
-    for (ch = 0; ch < FMTGSINK_MAX_VOICES; ch++) {
-        if (voices_[ch].noteNo == note && voices_[ch].channel == channel) {
-            break;
-        }
+    if (channel == kDrumChannel && note <= 127 && (rhythm_notes_[note >> 5] & (1UL << (note & 31)))) {
+        // リズム音で鳴らしたノートは、ノートオフを無視する
+        rhythm_notes_[note >> 5] &= ~(1UL << (note & 31));
+        return true;
     }
 
-    if (ch == FMTGSINK_MAX_VOICES) {
+    // Note Off すべきチャンネルを探す
+    int voice = allocator_.noteOff(note, channel);
+    if (voice == VoiceAllocator::kInvalidVoice) {
         // Note Off すべきチャンネルが見つからなかった
         return false;
     }
 
-    OPLL_writeReg(opll_, 0x20 + ch, 0x00); // keyoff
-
-    voices_[ch].noteNo = INVALID_NOTE_NUMBER;
-
-    for (auto it = keyOnLog_.begin(); it != keyOnLog_.end(); ) {
-        if (*it == ch) {
-            it = keyOnLog_.erase(it);
-        } else {
-            ++it;
-        }
-    }
+    // ブロックと F-Number はそのままにして、リリース中もピッチを保つ
+    OPLL_writeReg(getChip(voice), 0x20 + getChipCh(voice), voice_bf_[voice] >> 8); // keyoff
 
     return true;
 }
@@ -9,13 +9,20 @@
 
 #include <stdint.h>
 
-#include <vector>
-
 #include <Arduino.h>
 
 #include <File.h>
 
+#include "CpuGovernor.h"
+#include "MidiEventQueue.h"
 #include "PcmRenderer.h"
+#include "PitchTable.h"
+#include "SmfFileSource.h"
+#include "SmfSequencer.h"
+#include "StageProfiler.h"
+#include "VgmFileSource.h"
+#include "VgmPlayer.h"
+#include "VoiceAllocator.h"
 #include "WavReader.h"
 #include "YuruInstrumentFilter.h"
 
@@ -23,31 +30,253 @@ extern "C" {
 #include "emu2413.h"
 }
 
-#define FMTGSINK_MAX_VOICES 3
+// 1 チップあたりの発音数
+// 実際の発音数は、FMTGSINK_MIN_VOICES から FMTGSINK_MAX_VOICES の間で、生成にかかる時間に合わせて
+// CpuGovernor が増減させる（FMTGSINK_GOVERNOR が 0 のときや無効にしたときは FMTGSINK_DEFAULT_VOICES のまま）
+#define FMTGSINK_MAX_VOICES 9
+
+#ifndef FMTGSINK_MIN_VOICES
+#define FMTGSINK_MIN_VOICES 1
+#endif
+
+#ifndef FMTGSINK_DEFAULT_VOICES
+#define FMTGSINK_DEFAULT_VOICES 3
+#endif
+
+#ifndef FMTGSINK_GOVERNOR
+#define FMTGSINK_GOVERNOR 1
+#endif
+
+// 起動時のリズムモードの使い方 (FMTGSink::RhythmMode)
+// リズムモードでは、MIDI チャンネル 10 の GM ドラムのノートを OPLL のリズム音 (BD, SD, TOM, CYM, HH) で鳴らす
+// リズム音にはチップ 0 のチャンネル 7 - 9 を使うので、その間は 1 チップあたりの発音数を FMTGSINK_RHYTHM_VOICES までにする
+#ifndef FMTGSINK_RHYTHM_MODE
+#define FMTGSINK_RHYTHM_MODE 2  // kRhythmAuto
+#endif
+
+#define FMTGSINK_RHYTHM_VOICES 6
+
+// 同時に使える OPLL の最大数（実際に使う数は begin() の前に PARAMID_CHIP_NUM で設定する）
+#ifndef FMTGSINK_MAX_CHIPS
+#define FMTGSINK_MAX_CHIPS 4
+#endif
+
+#ifndef FMTGSINK_DEFAULT_CHIPS
+#define FMTGSINK_DEFAULT_CHIPS 1
+#endif
+
+// SMF のイベントを、発音時刻のどれだけ前からキューに入れておくか (us)
+#ifndef FMTGSINK_SMF_LOOKAHEAD_US
+#define FMTGSINK_SMF_LOOKAHEAD_US 10000
+#endif
+
+// VGM 再生時の発音数
+#ifndef FMTGSINK_VGM_VOICES
+#define FMTGSINK_VGM_VOICES 9
+#endif
+
+// 1 ブロックのサンプル数の最大値（偶数）
+#define FMTGSINK_MAX_BLOCK_SAMPLES 240
+
+// 起動時のレイテンシーのモード (FMTGSink::LatencyMode)
+#ifndef FMTGSINK_LATENCY_MODE
+#define FMTGSINK_LATENCY_MODE 1  // kLatencyNormal
+#endif
+
+// 起動時の出力のチャンネル数 (1: モノラル、2: ステレオ)
+// エミュレータの出力はモノラルなので、パン (CC#10) を使わなければモノラルのままレンダラーに渡す方が
+// バッファも転送量も半分で済む。ステレオにしても、パンを振ったボイスがなければモノラルで生成して複製する
+#ifndef FMTGSINK_OUTPUT_CHANNELS
+#define FMTGSINK_OUTPUT_CHANNELS 1
+#endif
+
+// 1 にすると、処理の段階ごとのサイクル数を集計して PARAMID_PROFILE_* で読み出せるようにする
+// エミュレータ内部の段階 (update_ampm、update_slots、チャンネルの計算、mix_output) も集計するには、
+// すべてのファイルで OPLL_PROFILE を 1 に定義してビルドする（0 ならそれらの段階は 0 のまま）
+#ifndef FMTGSINK_PROFILE
+#define FMTGSINK_PROFILE 0
+#endif
 
 class FMTGSink : public NullFilter {
 private:
-    OPLL *opll_;
+    OPLL *opll_[FMTGSINK_MAX_CHIPS];
+    int chip_num_;
+    int mix_shift_;  // 複数チップを加算するときのヘッドルーム
+
+    // MIDI チャンネルごとのピッチの設定
+    struct ChannelPitch {
+        int16_t bend;          // ピッチベンド (-8192 - 8191)
+        uint16_t bend_range;   // RPN 0 (MSB: 半音, LSB: セント)
+        uint16_t fine_tune;    // RPN 1 (8192 が中央、±100 セント)
+        uint8_t coarse_tune;   // RPN 2 の MSB (64 が中央、半音単位)
+        uint16_t rpn;          // データエントリーの対象の RPN (kRpnNull: なし)
+        int32_t offset;        // 上記をまとめたピッチのずれ (1/256 半音単位)
+    };
 
     int volume_;
     int inst_[16];  // 各チャンネルに設定した音色番号
-    PcmRenderer renderer_;
+    ChannelPitch pitch_[16];
+    uint16_t pitch_dirty_;  // ピッチが変わった MIDI チャンネルのビットマップ
+    uint16_t voice_bf_[FMTGSINK_MAX_CHIPS * FMTGSINK_MAX_VOICES];  // 各ボイスに書き込んだブロックと F-Number
+    uint8_t pan_[16];  // 各チャンネルのパン (CC#10, 64 が中央)
+    uint8_t voice_pan_[FMTGSINK_MAX_CHIPS * FMTGSINK_MAX_VOICES];  // 各ボイスの OPLL のチャンネルに設定したパン
+    uint64_t panned_voices_;  // パンが中央でないボイスのビットマップ
+    PitchTable pitch_table_;
+    PcmRenderer *renderer_;  // ブロックの大きさがレイテンシーのモードで決まるので、begin() で作る
+    VoiceAllocator allocator_;
+    MidiEventQueue event_queue_;
+    uint32_t block_time_;  // 次にレンダリングするブロックの先頭に対応するイベント時刻
+    bool block_time_valid_;
+
+    // VGM 再生中は MIDI で鳴らす OPLL の代わりに、VGM のクロックで作った OPLL を鳴らす
+    OPLL *vgm_opll_;
+    VgmFileSource vgm_source_;
+    VgmPlayer vgm_player_;
+
+    // SMF のイベントは、受信した MIDI イベントとは別のキューに時刻付きで入れ、レンダリングの際に時刻順に合わせる
+    // （先読みした SMF のイベントの後ろで MIDI 入力が待たされたり、キューが埋まって捨てられたりしないように）
+    SmfFileSource smf_source_;
+    SmfSequencer smf_sequencer_;
+    MidiEventQueue smf_queue_;
+    bool smf_playing_;
+    uint32_t smf_start_;  // 曲の先頭に対応するイベント時刻
 
-    struct Voice {
-        int noteNo;
-        int channel;
+    // レンダラーのバッファの状態の記録（update() のたびに更新する）
+    struct Telemetry {
+        uint32_t update_count;        // update() を呼ばれた回数
+        uint32_t block_count;         // 生成したブロック数
+        uint32_t max_blocks;          // 1 回の update() で生成したブロック数の最大値
+        uint32_t low_water_us;        // update() の時点でバッファに残っていた音の長さの最小値 (us)
+        uint32_t underrun_count;      // update() の時点でバッファが空になっていた回数（連続した場合は 1 回）
+        uint32_t max_interval_us;     // update() の間隔の最大値 (us)
     };
-    
-    Voice voices_[FMTGSINK_MAX_VOICES];
-    std::vector<int> keyOnLog_;
+    Telemetry telemetry_;
+
+    // レイテンシーのモードで決まる値（begin() で設定する）
+    int latency_mode_;
+    int sample_count_;        // 1 ブロックのサンプル数
+    int block_size_;          // 1 ブロックのバイト数
+    uint32_t block_us_;       // 1 ブロックの時間 (us)
+    int32_t event_delay_us_;  // MIDI イベントを受信してから発音するまでの遅延 (us, ブロックとバッファの大きさで決まる)
+    uint32_t latency_us_;     // 理論上のレイテンシー (us)
+    void setLatencyMode(int mode);
+    int channel_count_;       // 出力のチャンネル数 (1 or 2)
+    int bytes_per_sec_;       // 出力の 1 秒あたりのバイト数
+    size_t buffer_capacity_;  // レンダラーのバッファの大きさ（バイト）
+    bool underrun_;           // 前回の update() でバッファが空だった
+    uint32_t last_update_;    // 前回の update() の時刻 (micros())
+    bool last_update_valid_;
+    void resetTelemetry(void);
+    void checkBuffer(int ch);
+
+    // 発音数の上限（1 チップあたり）
+    // 上限を下げたときは、外したボイスをキーオフしてリリースが終わるまで OPLL の発音数を残しておく
+    CpuGovernor governor_;
+    int voice_limit_;     // アロケータに割り当てさせる発音数
+    int opll_voices_;     // OPLL で生成している発音数 (>= voice_limit_)
+    int shrink_wait_;     // opll_voices_ を voice_limit_ まで減らすのを待っているブロック数の残り (0: 待っていない)
+    void setVoiceLimit(int limit);
+    void setOpllVoices(int voices);
+    void updateGovernor(uint32_t render_us);
+    bool isReleasing(int limit);
+
+    // リズムモード（チップ 0 だけで使う）
+    int rhythm_mode_;         // RhythmMode
+    bool rhythm_on_;          // リズムモードで鳴らしている
+    uint8_t rhythm_keys_;     // キーオンしているリズム音 (レジスタ 0x0e の下位 5 bit)
+    uint8_t rhythm_vol_[3];   // リズム音の音量 (レジスタ 0x36 - 0x38)
+    uint32_t rhythm_notes_[4];  // リズム音で鳴らした MIDI チャンネル 10 のノートのビットマップ
+    void setRhythm(bool on);
+    bool prepareRhythm(void);
+    void clearRhythmNotes(void);
+    bool sendDrumOn(uint8_t note, uint8_t velocity);
 
-    void writeToRenderer(int ch);
+#if FMTGSINK_PROFILE
+    StageProfiler profiler_;
+    void collectEngineProfile(void);
+#endif
+
+    // レンダラーに渡すステレオの PCM (L, R の int16 を 1 ワードにまとめたもの)
+    // 後半はエミュレータがモノラルで生成するのにも使う
+    uint32_t pcm_buffer_[FMTGSINK_MAX_BLOCK_SAMPLES];
+
+    int writeToRenderer(int ch);
+    void renderBlock(int16_t *out, int sample_num);
+    void renderBlockStereo(int16_t *out, int sample_num);
+    void renderBlockWithEvents(int16_t *out, int sample_num, bool stereo, uint32_t queued_us);
+    void setVoicePan(int voice, uint8_t pan);
+    void dispatchEvent(const MidiEvent &event);
+    void resetPitch(int channel);
+    void handleControlChange(uint8_t control, uint8_t value, uint8_t channel);
+    void updatePitchOffset(int channel);
+    void flushPitch(void);
+    bool startVgm(const char *path);
+    void stopVgm(void);
+    bool startSmf(const char *path);
+    void stopSmf(bool cut);
+    void feedSmf(void);
+    void allNotesOff(void);
+    OPLL *getChip(int voice) { return opll_[voice % chip_num_]; }
+    int getChipCh(int voice) { return voice / chip_num_; }
     int getPlayingChannelMap(void);
+    static int getVoiceLevel(int voice, void *context);
 
 public:
+    // ブロックの大きさ、レンダラーのバッファの大きさ、先読みするブロック数の組み合わせ
+    enum LatencyMode {
+        kLatencyLow,     // ライブ演奏向け。ブロックを小さくして、バッファも最小限にする
+        kLatencyNormal,  // 従来の設定
+        kLatencySafe,    // シーケンサーの再生向け。処理が一時的に遅れても途切れないようにバッファを大きくする
+        kLatencyModeNum
+    };
+
+    // MIDI チャンネル 10 (GM ドラム) の鳴らし方
+    enum RhythmMode {
+        kRhythmOff,   // リズムモードを使わず、ほかのチャンネルと同じくメロディの音色で鳴らす
+        kRhythmOn,    // 常にリズムモードで鳴らす
+        kRhythmAuto,  // CpuGovernor が余裕があると判断したときだけ、リズムモードで鳴らす（なければメロディの音色で鳴らす）
+        kRhythmModeNum
+    };
+
     enum ParamId {                             // MAGIC CHAR = 'F'
         PARAMID_INST            = ('F' << 8),  //<
-        PARAMID_PLAYING_CH_MAP  = PARAMID_INST + 16
+        PARAMID_PLAYING_CH_MAP  = PARAMID_INST + 16,
+        PARAMID_VOICE_POLICY,                  //< VoiceAllocator::Policy
+        PARAMID_CHIP_NUM,                      //< 1 - FMTGSINK_MAX_CHIPS, begin() の前に設定する
+        PARAMID_VGM_FILE,                      //< set: SD カード上の VGM ファイルのパス (const char *)、0 で停止
+                                               //< get: VGM を再生中なら 1
+        PARAMID_SMF_FILE,                      //< set: SD カード上の SMF のパス (const char *)、0 で停止
+                                               //< get: SMF を再生中なら 1
+        // 以下は FMTGSINK_PROFILE が 1 のときだけ使える。値は 1 ブロックあたりの CPU サイクル数
+        PARAMID_PROFILE_COUNT,                 //< get: 集計したブロック数、set: 0 で集計をやり直す
+        PARAMID_PROFILE_BUDGET,                //< 1 ブロックの時間 (サイクル数, read-only)
+        PARAMID_PROFILE_MIN,                   //< + StageProfiler::Stage: 最小値 (read-only)
+        PARAMID_PROFILE_AVG     = PARAMID_PROFILE_MIN + StageProfiler::kStageNum,  //< + Stage: 平均値 (read-only)
+        PARAMID_PROFILE_MAX     = PARAMID_PROFILE_AVG + StageProfiler::kStageNum,  //< + Stage: 最大値 (read-only)
+        PARAMID_PROFILE_HIST    = PARAMID_PROFILE_MAX + StageProfiler::kStageNum,  //< + Stage * kHistBins + ビン: 度数 (read-only)
+        // レンダラーのバッファの状態（いずれも PARAMID_UPDATE_COUNT を 0 に設定したときからの値）
+        PARAMID_UPDATE_COUNT    = PARAMID_PROFILE_HIST + StageProfiler::kStageNum * StageProfiler::kHistBins,
+                                               //< get: update() の回数、set: 0 で以下の記録をやり直す
+        PARAMID_BLOCK_COUNT,                   //< 生成したブロック数 (read-only)
+        PARAMID_MAX_BLOCKS_PER_UPDATE,         //< 1 回の update() で生成したブロック数の最大値 (read-only)
+        PARAMID_BUFFER_LOW_WATER_US,           //< update() の時点でバッファに残っていた音の長さの最小値 (us, read-only)
+        PARAMID_UNDERRUN_COUNT,                //< update() の時点でバッファが空になっていた回数 (read-only)
+        PARAMID_MAX_UPDATE_INTERVAL_US,        //< update() の間隔の最大値 (us, read-only)
+        // 発音数の調整
+        PARAMID_GOVERNOR,                      //< 1: 生成にかかる時間に合わせて発音数を増減させる、0: 固定
+        PARAMID_VOICE_LIMIT,                   //< 1 チップあたりの発音数の上限
+                                               //< (FMTGSINK_MIN_VOICES - FMTGSINK_MAX_VOICES, set は PARAMID_GOVERNOR が 0 のときだけ)
+        PARAMID_RHYTHM_ALLOWED,                //< リズムモードを使う余裕があれば 1 (read-only)
+        PARAMID_FIXED_COST_US,                 //< 推定した 1 ブロックあたりの固定の生成時間 (us, read-only)
+        PARAMID_VOICE_COST_US,                 //< 推定した 1 ブロック、1 ボイスあたりの生成時間 (us, read-only)
+        PARAMID_LATENCY_MODE,                  //< LatencyMode, begin() の前に設定する
+        PARAMID_LATENCY_US,                    //< 理論上のレイテンシー (us, read-only)
+                                               //< = イベントの遅延（バッファにたまっている音の長さを含む） + 先読みしたブロック
+        PARAMID_BLOCK_SAMPLES,                 //< 1 ブロックのサンプル数 (read-only)
+        PARAMID_OUTPUT_CHANNELS,               //< 出力のチャンネル数 (1: モノラル、2: ステレオ), begin() の前に設定する
+        PARAMID_RHYTHM_MODE,                   //< RhythmMode
+        PARAMID_RHYTHM_ON,                     //< リズムモードで鳴らしていれば 1 (read-only)
+        PARAMID_SMF_DROPPED_TRACKS,            //< 最後に再生した SMF で、SmfSequencer::kMaxTracks を超えたため鳴らさないトラック数 (read-only)
     };
 
     // Constructor
@@ -0,0 +1,69 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#ifndef MIDIEVENTQUEUE_H_
+#define MIDIEVENTQUEUE_H_
+
+#include <stdint.h>
+
+#include "SpscRing.h"
+
+// 受信時刻付きの MIDI イベント
+struct MidiEvent {
+    uint32_t time;    // 受信時刻 (micros())
+    uint8_t status;   // ステータスバイト（上位 4 bit: 種類、下位 4 bit: チャンネル 0-15）
+    uint8_t data1;
+    uint8_t data2;
+};
+
+// MIDI 入力（producer）から音源（consumer）へイベントを渡すキュー
+// 音源側はイベントの受信時刻をもとに、レンダリングするブロックの中の発音位置を決める
+class MidiEventQueue {
+public:
+    enum ParamId {                             // MAGIC CHAR = 'Q'
+        PARAMID_EVENT_QUEUE     = ('Q' << 8),  //< MidiEventQueue * (read-only)
+    };
+
+    static const size_t kSize = 256;
+
+    MidiEventQueue() : dropped_(0) {
+    }
+
+    // producer 側から呼ぶ。満杯の場合はイベントを捨てて false を返す
+    bool push(uint32_t time, uint8_t status, uint8_t data1, uint8_t data2) {
+        MidiEvent event = { time, status, data1, data2 };
+        if (!ring_.push(event)) {
+            dropped_++;
+            return false;
+        }
+        return true;
+    }
+
+    // consumer 側から呼ぶ
+    const MidiEvent *peek() const {
+        return ring_.peek();
+    }
+
+    bool pop(MidiEvent *event) {
+        return ring_.pop(event);
+    }
+
+    // producer 側から呼ぶ。満杯なら true（push() が失敗する）
+    bool isFull() const {
+        return ring_.size() >= kSize;
+    }
+
+    // 満杯のために捨てたイベントの数
+    uint32_t getDroppedCount() const {
+        return dropped_;
+    }
+
+private:
+    SpscRing<MidiEvent, kSize> ring_;
+    volatile uint32_t dropped_;
+};
+
+#endif  // MIDIEVENTQUEUE_H_
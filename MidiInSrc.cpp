@@ -6,53 +6,142 @@
 
 #if defined(ARDUINO_ARCH_SPRESENSE) && !defined(SUBCORE)
 
-#include <MIDI.h>
+#include <Arduino.h>
 
 #include "MidiInSrc.h"
 
-MIDI_CREATE_INSTANCE(HardwareSerial, Serial2, MIDI);
+#define MIDI_PORT Serial2
 
-MidiInSrc::MidiInSrc(Filter& filter) : BaseFilter(filter) {
+const unsigned long kMidiBaudrate = 31250;
+
+// update() 1 回あたりの受信処理の上限（MIDI が大量に届いても音声の生成を止めないため）
+const int kDefaultMaxEvents = 32;
+const int kDefaultTimeBudgetUs = 1000;
+
+MidiInSrc::MidiInSrc(Filter& filter) : BaseFilter(filter),
+    max_events_(kDefaultMaxEvents), time_budget_us_(kDefaultTimeBudgetUs), event_queue_(nullptr) {
 }
 
 MidiInSrc::~MidiInSrc() {
 }
 
 bool MidiInSrc::setParam(int param_id, intptr_t value) {
+    switch (param_id) {
+    case MidiInSrc::PARAMID_MAX_EVENTS:
+        if (value < 1) {
+            return false;
+        }
+        max_events_ = value;
+        return true;
+
+    case MidiInSrc::PARAMID_TIME_BUDGET_US:
+        if (value < 1) {
+            return false;
+        }
+        time_budget_us_ = value;
+        return true;
+
+    default:
+        break;
+    }
+
     return BaseFilter::setParam(param_id, value);
 }
 
 intptr_t MidiInSrc::getParam(int param_id) {
+    switch (param_id) {
+    case MidiInSrc::PARAMID_MAX_EVENTS:
+        return max_events_;
+
+    case MidiInSrc::PARAMID_TIME_BUDGET_US:
+        return time_budget_us_;
+
+    default:
+        break;
+    }
+
     return BaseFilter::getParam(param_id);
 }
 
 bool MidiInSrc::isAvailable(int param_id) {
+    switch (param_id) {
+    case MidiInSrc::PARAMID_MAX_EVENTS:
+        return true;
+
+    case MidiInSrc::PARAMID_TIME_BUDGET_US:
+        return true;
+
+    default:
+        break;
+    }
+
     return BaseFilter::isAvailable(param_id);
 }
 
 bool MidiInSrc::begin() {
-    MIDI.begin(MIDI_CHANNEL_OMNI);
-    return BaseFilter::begin();
+    MIDI_PORT.begin(kMidiBaudrate);
+    parser_.reset();
+
+    bool ok = BaseFilter::begin();
+
+    if (isAvailable(MidiEventQueue::PARAMID_EVENT_QUEUE)) {
+        event_queue_ = (MidiEventQueue *)getParam(MidiEventQueue::PARAMID_EVENT_QUEUE);
+    }
+
+    return ok;
+}
+
+void MidiInSrc::sendEvent(uint8_t status, uint8_t data1, uint8_t data2) {
+    if (event_queue_) {
+        // キューが満杯の場合は捨てる（順序が入れ替わるので、直接送ることはしない）
+        event_queue_->push(micros(), status, data1, data2);
+        return;
+    }
+
+    switch (status & 0xf0) {
+    case 0x90:
+        // ベロシティ 0 のノートオンはノートオフとして扱う
+        if (data2 == 0) {
+            sendNoteOff(data1, data2, status & 0x0f);
+        } else {
+            sendNoteOn(data1, data2, status & 0x0f);
+        }
+        break;
+
+    case 0x80:
+        sendNoteOff(data1, data2, status & 0x0f);
+        break;
+
+    default:
+        break;
+    }
 }
 
 void MidiInSrc::update() {
-    // process MIDI events
-    if (MIDI.read()) {
-        switch (MIDI.getType()) {
-        case midi::NoteOn:
-            sendNoteOn(MIDI.getData1(), MIDI.getData2(), MIDI.getChannel() - 1);
-            // memo: Arduino MIDI Library では、MIDI チャンネルを 1-16 で表現するが、
-            //       Sound Signal Processing Library for Spresense では 0-15 で扱うため調整する
-            break;
+    // UART に届いているバイトをすべて処理する。ただしイベント数と時間の上限を超えたら、残りは次回に回す
+    const unsigned long start = micros();
+    int events = 0;
 
-        case midi::NoteOff:
-            sendNoteOff(MIDI.getData1(), MIDI.getData2(), MIDI.getChannel() - 1);
-            break;
+    while (MIDI_PORT.available() > 0) {
+        MidiParser::Message msg;
+        if (!parser_.parse((uint8_t)MIDI_PORT.read(), &msg)) {
+            continue;
+        }
+
+        // システムメッセージ（MIDI クロック、アクティブセンシング等）は後段で使わないので、キューに入れず上限にも数えない
+        if (msg.status >= 0xf0) {
+            continue;
+        }
+
+        // memo: MIDI チャンネルはステータスバイトの下位 4 bit (0-15) で、
+        //       Sound Signal Processing Library for Spresense のチャンネル番号と同じ
+        sendEvent(msg.status, msg.data1, msg.data2);
 
-        default:
+        events++;
+        if (events >= max_events_ || (long)(micros() - start) >= time_budget_us_) {
             break;
         }
-    };
+    }
 
     BaseFilter::update();
 }
@@ -9,10 +9,17 @@
 
 #include <time.h>
 
+#include "MidiEventQueue.h"
+#include "MidiParser.h"
 #include "YuruInstrumentFilter.h"
 
 class MidiInSrc : public BaseFilter {
 public:
+    enum ParamId {                             // MAGIC CHAR = 'M'
+        PARAMID_MAX_EVENTS      = ('M' << 8),  //< 1 回の update() で処理するチャンネルメッセージ数の上限
+        PARAMID_TIME_BUDGET_US,                //< 1 回の update() で MIDI 受信に使う時間の上限 (us)
+    };
+
     MidiInSrc(Filter& filter);
     ~MidiInSrc();
 
@@ -21,6 +28,16 @@ public:
     bool isAvailable(int param_id) override;
     bool begin() override;
     void update() override;
+
+private:
+    MidiParser parser_;
+    int max_events_;
+    int time_budget_us_;
+
+    // 後段が MidiEventQueue を持っていれば、イベントは受信時刻を付けてそこに入れる
+    MidiEventQueue *event_queue_;
+
+    void sendEvent(uint8_t status, uint8_t data1, uint8_t data2);
 };
 
 #endif  // MIDIINSRC_H_
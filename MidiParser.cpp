@@ -0,0 +1,112 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#include "MidiParser.h"
+
+MidiParser::MidiParser() {
+    reset();
+}
+
+void MidiParser::reset() {
+    running_status_ = 0;
+    data_num_ = 0;
+    data_len_ = 0;
+    sysex_ = false;
+}
+
+uint8_t MidiParser::getDataLength(uint8_t status) {
+    switch (status & 0xf0) {
+    case 0x80:  // Note Off
+    case 0x90:  // Note On
+    case 0xa0:  // Polyphonic Key Pressure
+    case 0xb0:  // Control Change
+    case 0xe0:  // Pitch Bend
+        return 2;
+
+    case 0xc0:  // Program Change
+    case 0xd0:  // Channel Pressure
+        return 1;
+
+    default:
+        break;
+    }
+
+    switch (status) {
+    case 0xf1:  // MIDI Time Code Quarter Frame
+    case 0xf3:  // Song Select
+        return 1;
+
+    case 0xf2:  // Song Position Pointer
+        return 2;
+
+    default:
+        return 0;
+    }
+}
+
+bool MidiParser::parse(uint8_t byte, Message *msg) {
+    if (byte >= 0xf8) {
+        // リアルタイムメッセージ
+        msg->status = byte;
+        msg->data1 = 0;
+        msg->data2 = 0;
+        return true;
+    }
+
+    if (byte & 0x80) {
+        data_num_ = 0;
+
+        if (byte == 0xf0) {
+            // システムエクスクルーシブの開始。0xF7 か次のステータスバイトまで読み飛ばす
+            sysex_ = true;
+            running_status_ = 0;
+            return false;
+        }
+        sysex_ = false;
+
+        if (byte >= 0xf0) {
+            // システムコモンメッセージはランニングステータスを解除する
+            running_status_ = 0;
+            data_len_ = getDataLength(byte);
+            if (data_len_ == 0) {
+                // 0xF6 (Tune Request) など。0xF7 (EOX) は単独では意味がないので捨てる
+                if (byte == 0xf7) {
+                    return false;
+                }
+                msg->status = byte;
+                msg->data1 = 0;
+                msg->data2 = 0;
+                return true;
+            }
+        } else {
+            data_len_ = getDataLength(byte);
+        }
+        running_status_ = byte;
+        return false;
+    }
+
+    // データバイト
+    if (sysex_ || running_status_ == 0) {
+        return false;
+    }
+
+    data_[data_num_++] = byte;
+    if (data_num_ < data_len_) {
+        return false;
+    }
+
+    msg->status = running_status_;
+    msg->data1 = data_[0];
+    msg->data2 = (data_len_ >= 2) ? data_[1] : 0;
+    data_num_ = 0;
+
+    if (running_status_ >= 0xf0) {
+        // システムコモンメッセージはランニングステータスの対象外
+        running_status_ = 0;
+    }
+
+    return true;
+}
@@ -0,0 +1,41 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#ifndef MIDIPARSER_H_
+#define MIDIPARSER_H_
+
+#include <stdint.h>
+
+// MIDI のバイト列をメッセージに組み立てる
+// ランニングステータスに対応する。リアルタイムメッセージ (0xF8-0xFF) は他のメッセージの途中に
+// 挟まっていてもその場で 1 つのメッセージとして返し、組み立て中のメッセージには影響しない。
+// システムエクスクルーシブは読み飛ばす。
+class MidiParser {
+public:
+    struct Message {
+        uint8_t status;  // チャンネルメッセージの場合、下位 4 bit がチャンネル (0-15)
+        uint8_t data1;
+        uint8_t data2;
+    };
+
+    MidiParser();
+
+    void reset();
+
+    // 1 バイトを入力し、メッセージが揃ったら true を返して *msg に格納する
+    bool parse(uint8_t byte, Message *msg);
+
+private:
+    uint8_t running_status_;  // 0: なし
+    uint8_t data_[2];
+    uint8_t data_num_;        // 受信済みのデータバイト数
+    uint8_t data_len_;        // running_status_ に必要なデータバイト数
+    bool sysex_;
+
+    static uint8_t getDataLength(uint8_t status);
+};
+
+#endif  // MIDIPARSER_H_
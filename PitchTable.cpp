@@ -0,0 +1,58 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#include <math.h>
+
+#include "PitchTable.h"
+
+PitchTable::PitchTable() {
+    init(0);
+}
+
+// F-number calculation come from SynthDriver.cpp in keijiro/vst2413
+// https://github.com/keijiro/vst2413/blob/master/source/SynthDriver.cpp
+//
+// ブロックは A のノートごとに 1 つ上がる（ノート 9 = A-1 がブロック 0）。
+// ベンドしないときのブロックと F-Number は、従来の CalculateBlockAndFNumber() と同じになる。
+void PitchTable::init(int fnum_a4) {
+    for (int note = 0; note < 128; note++) {
+        int block = (note - 9) / 12;
+        block = (block < 0) ? 0 : ((block > 7) ? 7 : block);
+        const int interval = note - 9 - block * 12;
+        const float fnum = fnum_a4 * powf(2.0f, (1.0f / 12) * interval);
+
+        block_[note] = block;
+        freq_[note] = (uint32_t)(fnum * (1 << kFracBits)) << block;
+    }
+}
+
+uint16_t PitchTable::getBlockFnum(int32_t pitch) const {
+    if (pitch < 0) {
+        pitch = 0;
+    } else if (pitch > kPitchMax) {
+        pitch = kPitchMax;
+    }
+
+    const int note = pitch >> kFracBits;
+    const uint32_t frac = pitch & ((1 << kFracBits) - 1);
+    uint32_t freq = freq_[note];
+    if (frac != 0) {
+        freq += ((freq_[note + 1] - freq) * frac) >> kFracBits;
+    }
+
+    // F-Number が 9 bit に収まらないときだけブロックを上げる
+    int block = block_[note];
+    uint32_t fnum = freq >> (block + kFracBits);
+    while (fnum > 0x1ff && block < 7) {
+        block++;
+        fnum = freq >> (block + kFracBits);
+    }
+    if (fnum > 0x1ff) {
+        fnum = 0x1ff;
+    }
+
+    return (block << 9) | fnum;
+}
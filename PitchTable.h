@@ -0,0 +1,35 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#ifndef PITCHTABLE_H_
+#define PITCHTABLE_H_
+
+#include <stdint.h>
+
+// ノート番号（とその小数部）から OPLL のブロックと F-Number を求める表
+//
+// 128 ノート分の周波数を init() で一度だけ計算しておき、ノートの間は固定小数点の線形補間で求める。
+// ピッチベンドやチューニングを反映するときにも浮動小数点演算を使わない。
+class PitchTable {
+public:
+    static const int kFracBits = 8;  // ピッチの小数部のビット数（1/256 半音単位）
+    static const int32_t kPitchMax = 127 << kFracBits;
+
+    PitchTable();
+
+    // fnum_a4: A4 (440Hz, ノート 69, ブロック 5) を鳴らすときの F-Number
+    void init(int fnum_a4);
+
+    // pitch: (ノート番号 << kFracBits) + 半音の小数部
+    // 戻り値: (ブロック << 9) | F-Number（レジスタ 0x20 の下位 4 bit と 0x10 の値）
+    uint16_t getBlockFnum(int32_t pitch) const;
+
+private:
+    uint32_t freq_[128];  // F-Number << (ブロック + kFracBits)、つまりブロック 0 換算の F-Number
+    uint8_t block_[128];  // ピッチベンドがないときのブロック
+};
+
+#endif  // PITCHTABLE_H_
@@ -0,0 +1,47 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#if defined(ARDUINO_ARCH_SPRESENSE) && !defined(SUBCORE)
+
+#include "SmfFileSource.h"
+
+SmfFileSource::SmfFileSource() : is_open_(false) {
+}
+
+SmfFileSource::~SmfFileSource() {
+    close();
+}
+
+bool SmfFileSource::open(const char *path) {
+    close();
+
+    if (!sd_.begin()) {
+        return false;
+    }
+    file_ = sd_.open(path);
+    if (!file_) {
+        return false;
+    }
+
+    is_open_ = true;
+    return true;
+}
+
+void SmfFileSource::close() {
+    if (is_open_) {
+        file_.close();
+        is_open_ = false;
+    }
+}
+
+int32_t SmfFileSource::readAt(uint32_t offset, uint8_t *buf, uint32_t size) {
+    if (!is_open_ || !file_.seek(offset)) {
+        return -1;
+    }
+    return file_.read(buf, size);
+}
+
+#endif  // ARDUINO_ARCH_SPRESENSE
@@ -0,0 +1,36 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#ifndef SMFFILESOURCE_H_
+#define SMFFILESOURCE_H_
+
+#include <stdint.h>
+
+#include <File.h>
+#include <SDHCI.h>
+
+#include "SmfSequencer.h"
+
+// SD カード上の SMF
+// SmfSequencer はトラックごとに小さなバッファで読み込むので、ファイル全体をメモリに読み込むことはない
+class SmfFileSource : public SmfSource {
+public:
+    SmfFileSource();
+    ~SmfFileSource();
+
+    bool open(const char *path);
+    void close();
+    bool isOpen() const { return is_open_; }
+
+    int32_t readAt(uint32_t offset, uint8_t *buf, uint32_t size) override;
+
+private:
+    SDClass sd_;
+    File file_;
+    bool is_open_;
+};
+
+#endif  // SMFFILESOURCE_H_
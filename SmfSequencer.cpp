@@ -0,0 +1,349 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#include <string.h>
+
+#include "SmfSequencer.h"
+
+const uint32_t kDefaultTempo = 500000;  // 120 BPM
+
+static uint32_t ReadBE32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint16_t ReadBE16(const uint8_t *p) {
+    return (p[0] << 8) | p[1];
+}
+
+int32_t SmfMemorySource::readAt(uint32_t offset, uint8_t *buf, uint32_t size) {
+    if (offset >= size_) {
+        return (offset == size_) ? 0 : -1;
+    }
+    if (size > size_ - offset) {
+        size = size_ - offset;
+    }
+    memcpy(buf, data_ + offset, size);
+    return size;
+}
+
+SmfSequencer::SmfSequencer() : source_(nullptr), track_num_(0), dropped_track_num_(0), heap_size_(0), next_valid_(false) {
+}
+
+bool SmfSequencer::begin(SmfSource *source) {
+    end();
+    dropped_track_num_ = 0;
+
+    uint8_t header[14];
+    if (source == nullptr || source->readAt(0, header, sizeof(header)) != sizeof(header)) {
+        return false;
+    }
+    if (memcmp(header, "MThd", 4) != 0 || ReadBE32(header + 4) < 6) {
+        return false;
+    }
+
+    format_ = ReadBE16(header + 8);
+    const int chunk_num = ReadBE16(header + 10);
+    division_ = ReadBE16(header + 12);
+    if (format_ > 1 || division_ == 0) {
+        // フォーマット 2 (独立したシーケンスの集まり) には対応しない
+        return false;
+    }
+
+    // トラックのチャンクの位置を調べる（MTrk 以外のチャンクは読み飛ばす）
+    source_ = source;
+    uint32_t offset = 8 + ReadBE32(header + 4);
+    for (int i = 0; i < chunk_num; i++) {
+        uint8_t chunk[8];
+        if (source->readAt(offset, chunk, sizeof(chunk)) != sizeof(chunk)) {
+            break;
+        }
+        const uint32_t len = ReadBE32(chunk + 4);
+        if (memcmp(chunk, "MTrk", 4) == 0) {
+            if (track_num_ < kMaxTracks) {
+                Track &t = tracks_[track_num_++];
+                t.pos = offset + 8;
+                t.end = t.pos + len;
+                t.buf_pos = t.buf_len = 0;
+                t.running_status = 0;
+                t.tick = 0;
+            } else {
+                // kMaxTracks を超えたトラックは読み込まず、数だけ数える
+                dropped_track_num_++;
+            }
+        }
+        offset += 8 + len;
+    }
+
+    base_tick_ = 0;
+    base_time_ = 0;
+    us_per_tick_num_ = 0;
+    us_per_tick_den_ = 1;
+    setTempo(0, kDefaultTempo);
+
+    for (int i = 0; i < track_num_; i++) {
+        readEvent(tracks_[i]);
+        if (tracks_[i].type != kEventEndOfTrack) {
+            heap_[heap_size_++] = i;
+            siftUp(heap_size_ - 1);
+        }
+    }
+
+    return true;
+}
+
+void SmfSequencer::end() {
+    source_ = nullptr;
+    track_num_ = 0;
+    heap_size_ = 0;
+    next_valid_ = false;
+}
+
+bool SmfSequencer::readByte(Track &t, uint8_t *value) {
+    if (t.buf_pos == t.buf_len) {
+        if (t.pos >= t.end) {
+            return false;
+        }
+        uint32_t size = t.end - t.pos;
+        if (size > kTrackBufferSize) {
+            size = kTrackBufferSize;
+        }
+        const int32_t read_size = source_->readAt(t.pos, t.buf, size);
+        if (read_size <= 0) {
+            return false;
+        }
+        t.pos += read_size;
+        t.buf_pos = 0;
+        t.buf_len = read_size;
+    }
+
+    *value = t.buf[t.buf_pos++];
+    return true;
+}
+
+bool SmfSequencer::readVarLen(Track &t, uint32_t *value) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        uint8_t b;
+        if (!readByte(t, &b)) {
+            return false;
+        }
+        v = (v << 7) | (b & 0x7f);
+        if (!(b & 0x80)) {
+            *value = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+// バッファに残っている分を捨て、残りはファイル上の位置を進めるだけにする
+bool SmfSequencer::skipBytes(Track &t, uint32_t len) {
+    const uint32_t buffered = t.buf_len - t.buf_pos;
+    if (len <= buffered) {
+        t.buf_pos += len;
+        return true;
+    }
+
+    len -= buffered;
+    t.buf_pos = t.buf_len;
+    if (len > t.end - t.pos) {
+        return false;
+    }
+    t.pos += len;
+    return true;
+}
+
+// トラックの次のイベントを読み込む
+void SmfSequencer::readEvent(Track &t) {
+    uint32_t delta;
+    uint8_t b;
+    if (!readVarLen(t, &delta) || !readByte(t, &b)) {
+        t.type = kEventEndOfTrack;
+        return;
+    }
+    t.tick += delta;
+
+    if (b == 0xff) {
+        // メタイベント
+        uint8_t type;
+        uint32_t len;
+        if (!readByte(t, &type) || !readVarLen(t, &len) || type == 0x2f) {
+            t.type = kEventEndOfTrack;
+            return;
+        }
+        t.running_status = 0;
+        if (type == 0x51 && len == 3) {
+            uint8_t tempo[3];
+            if (!readByte(t, &tempo[0]) || !readByte(t, &tempo[1]) || !readByte(t, &tempo[2])) {
+                t.type = kEventEndOfTrack;
+                return;
+            }
+            t.type = kEventTempo;
+            t.tempo = (tempo[0] << 16) | (tempo[1] << 8) | tempo[2];
+        } else {
+            t.type = skipBytes(t, len) ? kEventOther : kEventEndOfTrack;
+        }
+    } else if (b == 0xf0 || b == 0xf7) {
+        // SysEx（読み飛ばす）
+        uint32_t len;
+        t.running_status = 0;
+        t.type = (readVarLen(t, &len) && skipBytes(t, len)) ? kEventOther : kEventEndOfTrack;
+    } else if (b < 0xf0) {
+        // チャンネルメッセージ（ランニングステータスあり）
+        uint8_t status = b;
+        uint8_t data1 = 0;
+        uint8_t data2 = 0;
+        if (b & 0x80) {
+            t.running_status = b;
+            if (!readByte(t, &data1)) {
+                t.type = kEventEndOfTrack;
+                return;
+            }
+        } else if (t.running_status) {
+            status = t.running_status;
+            data1 = b;
+        } else {
+            t.type = kEventEndOfTrack;
+            return;
+        }
+        // プログラムチェンジとチャンネルプレッシャーはデータが 1 バイト
+        if ((status & 0xe0) != 0xc0 && !readByte(t, &data2)) {
+            t.type = kEventEndOfTrack;
+            return;
+        }
+        t.type = kEventChannel;
+        t.status = status;
+        t.data1 = data1;
+        t.data2 = data2;
+    } else {
+        // SMF には現れないはずのステータス
+        t.type = kEventEndOfTrack;
+    }
+}
+
+// ティックが同じなら、トラック番号の小さい方（フォーマット 1 のコンダクタートラック）を先にする
+bool SmfSequencer::isBefore(int a, int b) const {
+    const uint32_t ta = tracks_[heap_[a]].tick;
+    const uint32_t tb = tracks_[heap_[b]].tick;
+    return (ta != tb) ? (ta < tb) : (heap_[a] < heap_[b]);
+}
+
+void SmfSequencer::siftUp(int i) {
+    while (i > 0) {
+        const int parent = (i - 1) / 2;
+        if (!isBefore(i, parent)) {
+            break;
+        }
+        const uint8_t tmp = heap_[i];
+        heap_[i] = heap_[parent];
+        heap_[parent] = tmp;
+        i = parent;
+    }
+}
+
+void SmfSequencer::siftDown(int i) {
+    for (;;) {
+        const int left = i * 2 + 1;
+        const int right = left + 1;
+        int min = i;
+        if (left < heap_size_ && isBefore(left, min)) {
+            min = left;
+        }
+        if (right < heap_size_ && isBefore(right, min)) {
+            min = right;
+        }
+        if (min == i) {
+            break;
+        }
+        const uint8_t tmp = heap_[i];
+        heap_[i] = heap_[min];
+        heap_[min] = tmp;
+        i = min;
+    }
+}
+
+void SmfSequencer::setTempo(uint32_t tick, uint32_t tempo) {
+    base_time_ += (uint64_t)(tick - base_tick_) * us_per_tick_num_ / us_per_tick_den_;
+    base_tick_ = tick;
+    tempo_ = tempo;
+
+    if (division_ & 0x8000) {
+        // SMPTE（テンポに依存しない）。-29 は 29.97 fps
+        const int fps = -(int8_t)(division_ >> 8);
+        const int tpf = division_ & 0xff;
+        if (fps == 29) {
+            us_per_tick_num_ = 100000000;
+            us_per_tick_den_ = 2997 * tpf;
+        } else {
+            us_per_tick_num_ = 1000000;
+            us_per_tick_den_ = fps * tpf;
+        }
+    } else {
+        us_per_tick_num_ = tempo;
+        us_per_tick_den_ = division_;
+    }
+}
+
+uint32_t SmfSequencer::tickToTime(uint32_t tick) const {
+    return (uint32_t)(base_time_ + (uint64_t)(tick - base_tick_) * us_per_tick_num_ / us_per_tick_den_);
+}
+
+const SmfEvent *SmfSequencer::peek() {
+    if (next_valid_) {
+        return &next_;
+    }
+
+    while (heap_size_ > 0) {
+        Track &t = tracks_[heap_[0]];
+        bool found = false;
+
+        switch (t.type) {
+        case kEventChannel:
+            next_.time = tickToTime(t.tick);
+            next_.status = t.status;
+            next_.data1 = t.data1;
+            next_.data2 = t.data2;
+            found = true;
+            break;
+
+        case kEventTempo:
+            setTempo(t.tick, t.tempo);
+            break;
+
+        default:
+            break;
+        }
+
+        // トラックの次のイベントを読み込んで、ヒープの中の位置を直す
+        readEvent(t);
+        if (t.type == kEventEndOfTrack) {
+            heap_[0] = heap_[--heap_size_];
+        }
+        siftDown(0);
+
+        if (found) {
+            next_valid_ = true;
+            return &next_;
+        }
+    }
+
+    return nullptr;
+}
+
+bool SmfSequencer::pop(SmfEvent *event) {
+    const SmfEvent *next = peek();
+    if (next == nullptr) {
+        return false;
+    }
+
+    *event = *next;
+    next_valid_ = false;
+    return true;
+}
+
+bool SmfSequencer::isFinished() {
+    return peek() == nullptr;
+}
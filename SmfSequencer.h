@@ -0,0 +1,132 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#ifndef SMFSEQUENCER_H_
+#define SMFSEQUENCER_H_
+
+#include <stdint.h>
+
+// Standard MIDI File を読み出すインターフェース
+class SmfSource {
+public:
+    virtual ~SmfSource() {}
+
+    // offset から最大 size バイトを読み出し、読み出したバイト数を返す（エラーなら負の値）
+    virtual int32_t readAt(uint32_t offset, uint8_t *buf, uint32_t size) = 0;
+};
+
+// メモリ上（mmap したファイルなど）の SMF
+class SmfMemorySource : public SmfSource {
+public:
+    SmfMemorySource(const uint8_t *data, uint32_t size) : data_(data), size_(size) {
+    }
+
+    int32_t readAt(uint32_t offset, uint8_t *buf, uint32_t size) override;
+
+private:
+    const uint8_t *data_;
+    uint32_t size_;
+};
+
+// シーケンサーが出力するイベント（チャンネルメッセージのみ）
+struct SmfEvent {
+    uint32_t time;    // 曲の先頭からの時刻 (us)
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+// SMF (フォーマット 0 / 1) のシーケンサー
+//
+// ファイル全体をメモリに読み込まず、トラックごとの小さなバッファに少しずつ読み込みながら解釈する。
+// 各トラックの次のイベントをティックの小さい順に並べたヒープ（最小ヒープ）から取り出すことで、
+// 複数のトラックを時刻順にマージする。テンポチェンジはマージした順に反映するので、どのトラックにあってもよい。
+//
+// 再生できるトラック数は kMaxTracks まで（1 トラックあたり約 150 バイト）。GM の曲はコンダクタートラックと
+// 16 チャンネル分で 17 トラックになることが多いので、その倍の数にしてある。それより多い MTrk チャンクは
+// 読み込まずに再生し（begin() は成功する）、その数を getDroppedTrackNum() で返す。
+class SmfSequencer {
+public:
+    static const int kMaxTracks = 32;
+    static const int kTrackBufferSize = 128;
+
+    SmfSequencer();
+
+    bool begin(SmfSource *source);
+    void end();
+
+    // 次のイベントを返す（取り出さない）。曲の終わりなら nullptr
+    const SmfEvent *peek();
+
+    // 次のイベントを取り出す。曲の終わりなら false
+    bool pop(SmfEvent *event);
+
+    bool isFinished();
+
+    int getFormat() const { return format_; }
+    int getTrackNum() const { return track_num_; }
+
+    // kMaxTracks を超えたために読み込まなかったトラック数（次の begin() まで保持する）
+    int getDroppedTrackNum() const { return dropped_track_num_; }
+
+private:
+    enum EventType {
+        kEventChannel,
+        kEventTempo,
+        kEventOther,      // 読み飛ばすメタイベント、SysEx
+        kEventEndOfTrack
+    };
+
+    struct Track {
+        uint32_t pos;     // 次に読み込むファイル上の位置
+        uint32_t end;     // トラックの終わりの位置
+        uint8_t buf[kTrackBufferSize];
+        uint16_t buf_pos;
+        uint16_t buf_len;
+        uint8_t running_status;
+
+        // 次のイベント
+        uint32_t tick;
+        uint8_t type;     // EventType
+        uint8_t status;
+        uint8_t data1;
+        uint8_t data2;
+        uint32_t tempo;   // kEventTempo のとき (us / 四分音符)
+    };
+
+    SmfSource *source_;
+    int format_;
+    int track_num_;
+    int dropped_track_num_;
+    uint16_t division_;
+    Track tracks_[kMaxTracks];
+
+    // 次のイベントのティックが小さい順のトラック番号の最小ヒープ
+    uint8_t heap_[kMaxTracks];
+    int heap_size_;
+
+    // ティックから時刻への変換（最後のテンポチェンジの位置を基準にする）
+    uint32_t tempo_;          // us / 四分音符
+    uint32_t base_tick_;
+    uint64_t base_time_;      // us
+    uint64_t us_per_tick_num_;
+    uint32_t us_per_tick_den_;
+
+    SmfEvent next_;
+    bool next_valid_;
+
+    bool readByte(Track &t, uint8_t *value);
+    bool readVarLen(Track &t, uint32_t *value);
+    bool skipBytes(Track &t, uint32_t len);
+    void readEvent(Track &t);
+    bool isBefore(int a, int b) const;
+    void siftDown(int i);
+    void siftUp(int i);
+    void setTempo(uint32_t tick, uint32_t tempo);
+    uint32_t tickToTime(uint32_t tick) const;
+};
+
+#endif  // SMFSEQUENCER_H_
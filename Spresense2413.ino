@@ -37,11 +37,14 @@ const char *inst_name[] = {
 
 #define INIT_INST_NO 1 // Violin
 
+#define DEMO_VGM_FILE "demo.vgm" // D6 で再生する、SD カード上の VGM ファイル
+
 FMTGSink fmTGSink;
 MidiInSrc inst(fmTGSink);
 
 int button4 = HIGH;
 int button5 = HIGH;
+int button6 = HIGH;
 
 static void showCurrentInst(void)
 {
@@ -49,6 +52,40 @@ static void showCurrentInst(void)
     printf("Inst #%d: %s\n", instNo, inst_name[instNo]);
 }
 
+#if FMTGSINK_PROFILE
+#define PROFILE_INTERVAL_MS 5000 // 処理時間の集計を表示する間隔
+
+const char *stage_name[StageProfiler::kStageNum] = {
+    "update_ampm",
+    "update_slots",
+    "calc",
+    "mix_output",
+    "pack",
+    "write",
+    "block",
+};
+
+// 段階ごとの 1 ブロックあたりのサイクル数と、ブロックの時間に対する割合のヒストグラムを表示して、集計をやり直す
+static void showProfile(void)
+{
+    int budget = fmTGSink.getParam(FMTGSink::PARAMID_PROFILE_BUDGET);
+    printf("Profile: %d blocks, budget %d cycles/block\n", (int)fmTGSink.getParam(FMTGSink::PARAMID_PROFILE_COUNT), budget);
+    for (int stage = 0; stage < StageProfiler::kStageNum; stage++) {
+        int avg = fmTGSink.getParam(FMTGSink::PARAMID_PROFILE_AVG + stage);
+        printf("  %-12s min %8d avg %8d (%3d%%) max %8d  hist",
+               stage_name[stage],
+               (int)fmTGSink.getParam(FMTGSink::PARAMID_PROFILE_MIN + stage),
+               avg, (int)((int64_t)avg * 100 / budget),
+               (int)fmTGSink.getParam(FMTGSink::PARAMID_PROFILE_MAX + stage));
+        for (int bin = 0; bin < StageProfiler::kHistBins; bin++) {
+            printf(" %d", (int)fmTGSink.getParam(FMTGSink::PARAMID_PROFILE_HIST + stage * StageProfiler::kHistBins + bin));
+        }
+        printf("\n");
+    }
+    fmTGSink.setParam(FMTGSink::PARAMID_PROFILE_COUNT, 0);
+}
+#endif
+
 void setup() {
     // init built-in I/O
     Serial.begin(115200);
@@ -60,6 +97,7 @@ void setup() {
     // init buttons
     pinMode(PIN_D04, INPUT_PULLUP);
     pinMode(PIN_D05, INPUT_PULLUP);
+    pinMode(PIN_D06, INPUT_PULLUP);
 
     // initialize memory pool
     initMemoryPools();
@@ -79,8 +117,12 @@ void setup() {
     }
 
 
+    printf("latency: %d us (%d samples/block, %d ch)\n",
+           (int)fmTGSink.getParam(FMTGSink::PARAMID_LATENCY_US),
+           (int)fmTGSink.getParam(FMTGSink::PARAMID_BLOCK_SAMPLES),
+           (int)fmTGSink.getParam(FMTGSink::PARAMID_OUTPUT_CHANNELS));
     Serial.println("Ready to play Spresense EMU2413.");
-    Serial.println("[Button D4] Change instrument / [Button D5] Play A4(440Hz)");
+    Serial.println("[Button D4] Change instrument / [Button D5] Play A4(440Hz) / [Button D6] Play/Stop " DEMO_VGM_FILE);
     showCurrentInst();
 }
 
@@ -125,16 +167,61 @@ void loop() {
         }
     }
 
+    // Play/Stop the demo VGM file
+    int button6_input = digitalRead(PIN_D06);
+    if (button6_input != button6) {
+        delay(10);
+        if (digitalRead(PIN_D06) == button6_input) {
+            if (button6_input == LOW) {
+                if (fmTGSink.getParam(FMTGSink::PARAMID_VGM_FILE)) {
+                    fmTGSink.setParam(FMTGSink::PARAMID_VGM_FILE, 0);
+                } else if (!fmTGSink.setParam(FMTGSink::PARAMID_VGM_FILE, (intptr_t)DEMO_VGM_FILE)) {
+                    Serial.println("ERROR: cannot play " DEMO_VGM_FILE);
+                }
+            }
+            button6 = button6_input;
+        }
+    }
+
     // run instrument
     inst.update();
 
-    // Light the LED according to the playback channel
+    // Light the LED according to the playback channel (LED は 4 個なので、ボイス 0 - 3 だけ)
     int map = inst.getParam(FMTGSink::PARAMID_PLAYING_CH_MAP);
-    for (int ch = 0; ch < FMTGSINK_MAX_VOICES; ch++) {
+    for (int ch = 0; ch < FMTGSINK_MAX_VOICES && ch < 4; ch++) {
         if (map & (1 << ch)) {
             digitalWrite(LED0 + ch, HIGH);
         } else {
             digitalWrite(LED0 + ch, LOW);
         }
     }
+
+    // 発音数の上限が変わったら表示する
+    static int voice_limit = 0;
+    int limit = fmTGSink.getParam(FMTGSink::PARAMID_VOICE_LIMIT);
+    if (limit != voice_limit) {
+        voice_limit = limit;
+        printf("voice limit: %d per chip (voice cost %d us, fixed cost %d us)\n", limit,
+               (int)fmTGSink.getParam(FMTGSink::PARAMID_VOICE_COST_US),
+               (int)fmTGSink.getParam(FMTGSink::PARAMID_FIXED_COST_US));
+    }
+
+    // レンダラーのバッファが空になったら、そのときの状態を表示する
+    static int underrun_count = 0;
+    int underruns = fmTGSink.getParam(FMTGSink::PARAMID_UNDERRUN_COUNT);
+    if (underruns != underrun_count) {
+        underrun_count = underruns;
+        printf("WARNING: renderer underrun #%d (max update interval %d us, max %d blocks/update)\n",
+               underruns,
+               (int)fmTGSink.getParam(FMTGSink::PARAMID_MAX_UPDATE_INTERVAL_US),
+               (int)fmTGSink.getParam(FMTGSink::PARAMID_MAX_BLOCKS_PER_UPDATE));
+    }
+
+#if FMTGSINK_PROFILE
+    static unsigned long profile_time = millis();
+    if (millis() - profile_time >= PROFILE_INTERVAL_MS) {
+        profile_time = millis();
+        showProfile();
+    }
+#endif
 }
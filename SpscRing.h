@@ -0,0 +1,83 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#ifndef SPSCRING_H_
+#define SPSCRING_H_
+
+#include <stddef.h>
+
+#include <atomic>
+
+// 固定長のロックフリーなリングバッファ
+// push() を呼ぶスレッド（コア）と pop() を呼ぶスレッドがそれぞれ 1 つだけの場合に限り、排他なしで使える。
+// N は 2 のべき乗であること。格納できる要素数は N - 1 ではなく N。
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+    SpscRing() : head_(0), tail_(0) {
+    }
+
+    // producer 側から呼ぶ。満杯なら false
+    bool push(const T &item) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= N) {
+            return false;
+        }
+
+        buf_[tail & (N - 1)] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer 側から呼ぶ。空なら false
+    bool pop(T *item) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (tail_.load(std::memory_order_acquire) == head) {
+            return false;
+        }
+
+        *item = buf_[head & (N - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer 側から呼ぶ。先頭の要素を取り出さずに参照する。空なら nullptr
+    const T *peek() const {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (tail_.load(std::memory_order_acquire) == head) {
+            return nullptr;
+        }
+        return &buf_[head & (N - 1)];
+    }
+
+    // どちらの側から呼んでもよいが、値は呼んだ時点の目安
+    size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    static constexpr size_t capacity() {
+        return N;
+    }
+
+private:
+    // producer と consumer が書き込む変数を別のキャッシュラインに置く
+    // (alignas だと new で確保したときに C++17 より前では揃わないので、パディングで離す)
+    static const size_t kCacheLine = 64;
+
+    std::atomic<size_t> head_;
+    char pad0_[kCacheLine - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail_;
+    char pad1_[kCacheLine - sizeof(std::atomic<size_t>)];
+    T buf_[N];
+};
+
+#endif  // SPSCRING_H_
@@ -0,0 +1,62 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#include <string.h>
+
+#include "StageProfiler.h"
+
+#if defined(ARDUINO_ARCH_SPRESENSE)
+// Cortex-M4 のデバッグ用サイクルカウンタ
+static volatile uint32_t *const kDemcr = (volatile uint32_t *)0xe000edfc;
+static volatile uint32_t *const kDwtCtrl = (volatile uint32_t *)0xe0001000;
+static volatile uint32_t *const kDwtCyccnt = (volatile uint32_t *)0xe0001004;
+#endif
+
+StageProfiler::StageProfiler() : budget_(1) {
+    reset();
+}
+
+void StageProfiler::begin(uint32_t budget) {
+    budget_ = (budget > 0) ? budget : 1;
+    reset();
+
+#if defined(ARDUINO_ARCH_SPRESENSE)
+    *kDemcr |= 1 << 24;   // TRCENA
+    *kDwtCtrl |= 1 << 0;  // CYCCNTENA
+#endif
+}
+
+void StageProfiler::reset() {
+    memset(stats_, 0, sizeof(stats_));
+}
+
+void StageProfiler::add(int stage, uint32_t cycles) {
+    Stats &s = stats_[stage];
+    if (s.count == 0 || cycles < s.min) {
+        s.min = cycles;
+    }
+    if (cycles > s.max) {
+        s.max = cycles;
+    }
+    s.sum += cycles;
+    s.count++;
+
+    uint64_t bin = (uint64_t)cycles * kHistBins / budget_;
+    s.hist[(bin < kHistBins) ? bin : kHistBins - 1]++;
+}
+
+uint32_t StageProfiler::getAvg(int stage) const {
+    const Stats &s = stats_[stage];
+    return s.count ? (uint32_t)(s.sum / s.count) : 0;
+}
+
+uint32_t StageProfiler::now() {
+#if defined(ARDUINO_ARCH_SPRESENSE)
+    return *kDwtCyccnt;
+#else
+    return 0;
+#endif
+}
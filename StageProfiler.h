@@ -0,0 +1,61 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#ifndef STAGEPROFILER_H_
+#define STAGEPROFILER_H_
+
+#include <stdint.h>
+
+// オーディオ処理の段階ごとに、1 ブロックあたりのサイクル数の最小・平均・最大とヒストグラムを集計する
+//
+// ヒストグラムはブロックの時間（予算）を kHistBins 等分したもので、最後のビンには予算を超えた分も入る。
+class StageProfiler {
+public:
+    enum Stage {
+        kStageAmpm,    // update_ampm (LFO、ノイズ)
+        kStageSlots,   // update_slots (エンベロープ、位相)
+        kStageCalc,    // チャンネルごとのモジュレータ／キャリアの計算
+        kStageMix,     // mix_output
+        kStagePack,    // writeToRenderer でのバイト列への詰め替え
+        kStageWrite,   // renderer_.write
+        kStageBlock,   // 1 ブロックの処理全体
+        kStageNum
+    };
+
+    static const int kHistBins = 8;
+
+    StageProfiler();
+
+    // budget: 1 ブロックの時間（サイクル数）。サイクルカウンタもここで動かし始める
+    void begin(uint32_t budget);
+    void reset();
+
+    void add(int stage, uint32_t cycles);
+
+    uint32_t getCount(int stage) const { return stats_[stage].count; }
+    uint32_t getMin(int stage) const { return stats_[stage].count ? stats_[stage].min : 0; }
+    uint32_t getAvg(int stage) const;
+    uint32_t getMax(int stage) const { return stats_[stage].max; }
+    uint32_t getHist(int stage, int bin) const { return stats_[stage].hist[bin]; }
+    uint32_t getBudget() const { return budget_; }
+
+    // CPU のサイクルカウンタ (DWT_CYCCNT)
+    static uint32_t now();
+
+private:
+    struct Stats {
+        uint32_t count;
+        uint32_t min;
+        uint32_t max;
+        uint64_t sum;
+        uint32_t hist[kHistBins];
+    };
+
+    Stats stats_[kStageNum];
+    uint32_t budget_;
+};
+
+#endif  // STAGEPROFILER_H_
@@ -0,0 +1,106 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#if defined(ARDUINO_ARCH_SPRESENSE) && !defined(SUBCORE)
+
+#include "VgmFileSource.h"
+
+VgmFileSource::VgmFileSource() : is_open_(false) {
+    seek(0);
+}
+
+VgmFileSource::~VgmFileSource() {
+    close();
+}
+
+bool VgmFileSource::open(const char *path) {
+    close();
+
+    if (!sd_.begin()) {
+        return false;
+    }
+    file_ = sd_.open(path);
+    if (!file_) {
+        return false;
+    }
+
+    is_open_ = true;
+    seek(0);
+    return true;
+}
+
+void VgmFileSource::close() {
+    if (is_open_) {
+        file_.close();
+        is_open_ = false;
+    }
+}
+
+void VgmFileSource::prefetch() {
+    if (!is_open_ || size_[fill_] != 0) {
+        // 両方のバッファが埋まっている（VgmPlayer が使用中のバッファも含む）
+        return;
+    }
+
+    if (seek_pending_) {
+        file_.seek(file_pos_);
+        seek_pending_ = false;
+    }
+
+    int32_t size = file_.read(buffer_[fill_], kBufferSize);
+    if (size <= 0) {
+        size = -1;
+    } else {
+        file_pos_ += size;
+    }
+    size_[fill_] = size;
+    fill_ ^= 1;
+}
+
+bool VgmFileSource::readAt(uint32_t offset, uint8_t *buf, uint32_t size) {
+    if (!is_open_ || !file_.seek(offset)) {
+        return false;
+    }
+    const bool ok = (file_.read(buf, size) == (int)size);
+
+    // 先読みは読み込み位置から再開する
+    seek_pending_ = true;
+    return ok;
+}
+
+// 実際のシークは次の prefetch() で行う（レンダリング中に SD カードにアクセスしないため）
+bool VgmFileSource::seek(uint32_t offset) {
+    size_[0] = size_[1] = 0;
+    fill_ = use_ = 0;
+    in_use_ = false;
+    file_pos_ = offset;
+    seek_pending_ = true;
+    return true;
+}
+
+int32_t VgmFileSource::read(const uint8_t **data) {
+    // 前回返したバッファを解放する
+    if (in_use_) {
+        size_[use_ ^ 1] = 0;
+        in_use_ = false;
+    }
+
+    const int32_t size = size_[use_];
+    if (size == 0) {
+        // まだ読み込まれていない
+        return 0;
+    }
+    if (size < 0) {
+        return -1;
+    }
+
+    *data = buffer_[use_];
+    in_use_ = true;
+    use_ ^= 1;
+    return size;
+}
+
+#endif  // ARDUINO_ARCH_SPRESENSE
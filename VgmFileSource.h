@@ -0,0 +1,56 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#ifndef VGMFILESOURCE_H_
+#define VGMFILESOURCE_H_
+
+#include <stdint.h>
+
+#include <File.h>
+#include <SDHCI.h>
+
+#include "VgmPlayer.h"
+
+// SD カード上の VGM ファイルを、ダブルバッファで先読みしながら VgmPlayer に渡す
+//
+// SD カードからの読み出しは prefetch() でだけ行い、read() は読み出し済みのバッファを返すだけなので
+// レンダリング中にブロックしない。prefetch() はレンダリングの合間（FMTGSink::update() の最後）に呼ぶ。
+class VgmFileSource : public VgmSource {
+public:
+    static const int kBufferSize = 2048;
+
+    VgmFileSource();
+    ~VgmFileSource();
+
+    bool open(const char *path);
+    void close();
+    bool isOpen() const { return is_open_; }
+
+    // 空いているバッファを 1 つ読み込む（ブロックする）
+    void prefetch();
+
+    bool readAt(uint32_t offset, uint8_t *buf, uint32_t size) override;
+
+    // 先読みしたデータを捨てて、次の prefetch() で offset から読み直す
+    // （ループの先頭に戻るときなどは、次の prefetch() までの間 read() がデータを返さない）
+    bool seek(uint32_t offset) override;
+    int32_t read(const uint8_t **data) override;
+
+private:
+    SDClass sd_;
+    File file_;
+    bool is_open_;
+
+    uint8_t buffer_[2][kBufferSize];
+    int32_t size_[2];   // 読み込んだバイト数（0: 空き、負の値: ファイルの終端）
+    int fill_;          // 次に prefetch() で読み込むバッファ
+    int use_;           // 次に read() で返すバッファ
+    bool in_use_;       // read() で返したバッファ (use_ の前) を VgmPlayer が使用中
+    uint32_t file_pos_; // 次に prefetch() で読み込むファイル上の位置
+    bool seek_pending_;
+};
+
+#endif  // VGMFILESOURCE_H_
@@ -0,0 +1,287 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#include <string.h>
+
+#include "VgmPlayer.h"
+
+static uint32_t ReadLE32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool VgmMemorySource::readAt(uint32_t offset, uint8_t *buf, uint32_t size) {
+    if (offset > size_ || size > size_ - offset) {
+        return false;
+    }
+    memcpy(buf, data_ + offset, size);
+    return true;
+}
+
+bool VgmMemorySource::seek(uint32_t offset) {
+    pos_ = (offset < size_) ? offset : size_;
+    return true;
+}
+
+int32_t VgmMemorySource::read(const uint8_t **data) {
+    if (pos_ >= size_) {
+        return -1;
+    }
+
+    // 残りをすべて一度に返す
+    *data = data_ + pos_;
+    const int32_t size = size_ - pos_;
+    pos_ = size_;
+    return size;
+}
+
+VgmPlayer::VgmPlayer() : source_(nullptr), finished_(false), stall_count_(0) {
+}
+
+bool VgmPlayer::begin(VgmSource *source, uint32_t out_rate, int loop_num) {
+    end();
+
+    uint8_t header[0x40];
+    if (source == nullptr || out_rate == 0 || !source->readAt(0, header, sizeof(header))) {
+        return false;
+    }
+    if (memcmp(header, "Vgm ", 4) != 0) {
+        return false;
+    }
+
+    version_ = ReadLE32(header + 0x08);
+    clock_ = ReadLE32(header + 0x10) & 0x3fffffff;  // bit 30, 31 はデュアルチップ、VRC7 のフラグ
+    total_samples_ = ReadLE32(header + 0x18);
+    eof_offset_ = ReadLE32(header + 0x04) + 0x04;
+    loop_offset_ = ReadLE32(header + 0x1c) ? ReadLE32(header + 0x1c) + 0x1c : 0;
+    data_offset_ = (version_ >= 0x150 && ReadLE32(header + 0x34)) ? ReadLE32(header + 0x34) + 0x34 : 0x40;
+
+    source_ = source;
+    out_rate_ = out_rate;
+    loop_num_ = loop_num;
+    wait_ = 0;
+    waited_ = false;
+    cmd_num_ = 0;
+    finished_ = false;
+    stall_count_ = 0;
+    restart(data_offset_);
+
+    return true;
+}
+
+void VgmPlayer::end() {
+    source_ = nullptr;
+    finished_ = false;
+}
+
+void VgmPlayer::restart(uint32_t offset) {
+    source_->seek(offset);
+    p_ = end_ = nullptr;
+    pos_ = offset;
+    carry_len_ = 0;
+    op_ = -1;
+    at_end_ = false;
+}
+
+bool VgmPlayer::nextChunk() {
+    const uint8_t *data;
+    const int32_t size = source_->read(&data);
+    if (size <= 0) {
+        if (size < 0) {
+            at_end_ = true;
+        }
+        return false;
+    }
+
+    p_ = data;
+    end_ = data + size;
+    return true;
+}
+
+// 連続した len バイトを返す。データがまだ届いていなければ nullptr
+const uint8_t *VgmPlayer::fetch(int len) {
+    if (carry_len_ == 0 && end_ - p_ >= len) {
+        const uint8_t *ret = p_;
+        p_ += len;
+        pos_ += len;
+        return ret;
+    }
+
+    // チャンクの境界をまたぐ場合は carry_ に集める（途中で止まっても、次の呼び出しで続きから集める）
+    while (carry_len_ < len) {
+        if (p_ == end_ && !nextChunk()) {
+            return nullptr;
+        }
+        carry_[carry_len_++] = *p_++;
+    }
+    carry_len_ = 0;
+    pos_ += len;
+    return carry_;
+}
+
+void VgmPlayer::loopOrFinish() {
+    if (loop_offset_ != 0 && loop_num_ != 0 && waited_) {
+        if (loop_num_ > 0) {
+            loop_num_--;
+        }
+        waited_ = false;
+        restart(loop_offset_);
+    } else {
+        finished_ = true;
+    }
+}
+
+// fetch() がデータを返さなかったとき。ファイルの終端ならループまたは終了して true、まだ届いていないだけなら false
+bool VgmPlayer::handleNoData() {
+    if (at_end_) {
+        loopOrFinish();
+        return true;
+    }
+    return false;
+}
+
+int VgmPlayer::getOperandLength(uint8_t op) {
+    if (0x30 <= op && op <= 0x3f) {
+        return 1;
+    } else if ((0x40 <= op && op <= 0x4e) || (0x51 <= op && op <= 0x5f) || (0xa0 <= op && op <= 0xbf)) {
+        return 2;
+    } else if (0xc0 <= op && op <= 0xdf) {
+        return 3;
+    } else if (0xe0 <= op) {
+        return 4;
+    }
+
+    switch (op) {
+    case 0x4f:
+    case 0x50:
+    case 0x94:
+        return 1;
+    case 0x61:
+        return 2;
+    case 0x67:
+        return 6;   // 0x66, 種類, サイズ (4 バイト)
+    case 0x68:
+        return 11;
+    case 0x90:
+    case 0x91:
+    case 0x95:
+        return 4;
+    case 0x92:
+        return 5;
+    case 0x93:
+        return 10;
+    default:
+        return 0;   // 0x62, 0x63, 0x66, 0x7n, 0x8n など
+    }
+}
+
+// コマンドを 1 つ処理する。データが届いていなければ false
+bool VgmPlayer::step(OPLL *opll) {
+    if (pos_ >= eof_offset_) {
+        loopOrFinish();
+        return true;
+    }
+
+    if (op_ < 0) {
+        const uint8_t *p = fetch(1);
+        if (p == nullptr) {
+            return handleNoData();
+        }
+        op_ = p[0];
+    }
+
+    const uint8_t *arg = nullptr;
+    const int len = getOperandLength(op_);
+    if (len > 0) {
+        arg = fetch(len);
+        if (arg == nullptr) {
+            return handleNoData();
+        }
+    }
+
+    const uint8_t op = op_;
+    op_ = -1;
+
+    switch (op) {
+    case 0x51:  // YM2413 write
+        if (cmd_num_ == kMaxCmds) {
+            flush(opll);
+        }
+        cmds_[cmd_num_++] = OPLL_REG_CMD(arg[0], arg[1]);
+        break;
+
+    case 0x61:  // wait n samples
+        wait_ += (uint64_t)(arg[0] | (arg[1] << 8)) * out_rate_;
+        waited_ = true;
+        break;
+
+    case 0x62:  // wait 1/60 s
+        wait_ += (uint64_t)735 * out_rate_;
+        waited_ = true;
+        break;
+
+    case 0x63:  // wait 1/50 s
+        wait_ += (uint64_t)882 * out_rate_;
+        waited_ = true;
+        break;
+
+    case 0x66:  // end of sound data
+        loopOrFinish();
+        break;
+
+    case 0x67:  // data block (YM2413 では使わないので読み飛ばす)
+        restart(pos_ + (ReadLE32(arg + 2) & 0x7fffffff));
+        break;
+
+    default:
+        if ((op & 0xf0) == 0x70) {
+            wait_ += (uint64_t)((op & 0x0f) + 1) * out_rate_;
+            waited_ = true;
+        } else if ((op & 0xf0) == 0x80) {
+            wait_ += (uint64_t)(op & 0x0f) * out_rate_;
+            waited_ = true;
+        }
+        break;
+    }
+
+    return true;
+}
+
+void VgmPlayer::flush(OPLL *opll) {
+    if (cmd_num_ > 0) {
+        OPLL_writeRegs(opll, cmds_, cmd_num_);
+        cmd_num_ = 0;
+    }
+}
+
+void VgmPlayer::render(OPLL *opll, int16_t *out, uint32_t n) {
+    uint32_t done = 0;
+
+    while (done < n) {
+        const bool playing = isPlaying();
+
+        if (!playing || wait_ >= kVgmRate) {
+            uint32_t k = n - done;
+            if (playing && wait_ / kVgmRate < k) {
+                k = (uint32_t)(wait_ / kVgmRate);
+            }
+            flush(opll);
+            OPLL_calcBlock(opll, out + done, k);
+            done += k;
+            if (playing) {
+                wait_ -= (uint64_t)k * kVgmRate;
+            }
+            continue;
+        }
+
+        if (!step(opll)) {
+            // データが間に合わなかった。音は止めずに生成だけ続け、次の render() で続きから処理する
+            stall_count_++;
+            flush(opll);
+            OPLL_calcBlock(opll, out + done, n - done);
+            break;
+        }
+    }
+}
@@ -0,0 +1,117 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#ifndef VGMPLAYER_H_
+#define VGMPLAYER_H_
+
+#include <stdint.h>
+
+extern "C" {
+#include "emu2413.h"
+}
+
+// VGM ファイルのデータを読み出すインターフェース
+//
+// read() はファイルの先頭から順に、連続したデータを少しずつ返す。
+// 返したデータは、次に read() か seek() を呼ぶまで有効であること。
+class VgmSource {
+public:
+    virtual ~VgmSource() {}
+
+    // ヘッダの読み出し用。begin() からだけ呼ばれるので、ブロックしてよい
+    virtual bool readAt(uint32_t offset, uint8_t *buf, uint32_t size) = 0;
+
+    // 次に read() で返す位置を変える
+    virtual bool seek(uint32_t offset) = 0;
+
+    // 次のデータを *data に返し、そのバイト数を返す。
+    // まだデータが届いていなければ 0、ファイルの終端またはエラーなら負の値
+    // （レンダリング中に呼ばれるので、ブロックしないこと）
+    virtual int32_t read(const uint8_t **data) = 0;
+};
+
+// メモリ上（mmap したファイルやフラッシュ上の配列）の VGM データ
+class VgmMemorySource : public VgmSource {
+public:
+    VgmMemorySource(const uint8_t *data, uint32_t size) : data_(data), size_(size), pos_(0) {
+    }
+
+    bool readAt(uint32_t offset, uint8_t *buf, uint32_t size) override;
+    bool seek(uint32_t offset) override;
+    int32_t read(const uint8_t **data) override;
+
+private:
+    const uint8_t *data_;
+    uint32_t size_;
+    uint32_t pos_;
+};
+
+// VGM ファイルの YM2413 のコマンド (0x51) を OPLL に書き込みながら再生する
+//
+// ウェイトは VGM のサンプルレート (44.1kHz) から出力のサンプルレートに変換し、
+// その間は OPLL_calcBlock でまとめて生成する。ウェイトの間のレジスタ書き込みは OPLL_writeRegs でまとめて反映する。
+// YM2413 以外のチップのコマンドは読み飛ばす。
+class VgmPlayer {
+public:
+    static const uint32_t kVgmRate = 44100;
+
+    VgmPlayer();
+
+    // loop_num: ループ区間を繰り返す回数（負の値なら無限に繰り返す）
+    bool begin(VgmSource *source, uint32_t out_rate, int loop_num = 0);
+    void end();
+
+    // n サンプルを生成する。データが届いていない間は、レジスタを書き換えずに OPLL の生成だけを続ける
+    void render(OPLL *opll, int16_t *out, uint32_t n);
+
+    bool isPlaying() const { return source_ != nullptr && !finished_; }
+    bool isFinished() const { return finished_; }
+
+    uint32_t getVersion() const { return version_; }
+    uint32_t getClock() const { return clock_; }  // ヘッダの YM2413 のクロック（0 なら YM2413 を使わないファイル）
+    uint32_t getTotalSamples() const { return total_samples_; }  // 44.1kHz でのサンプル数
+    uint32_t getStallCount() const { return stall_count_; }  // データが間に合わなかった回数
+
+private:
+    static const int kMaxCmds = 64;
+
+    VgmSource *source_;
+    uint32_t out_rate_;
+    int loop_num_;
+    uint32_t version_;
+    uint32_t clock_;
+    uint32_t total_samples_;
+    uint32_t data_offset_;
+    uint32_t loop_offset_;   // 0: ループしない
+    uint32_t eof_offset_;
+
+    // 読み出し中のチャンク
+    const uint8_t *p_;
+    const uint8_t *end_;
+    uint32_t pos_;           // 次のコマンドのファイル上の位置
+    uint8_t carry_[16];      // チャンクの境界をまたいだコマンドのバイト列
+    int carry_len_;
+    int op_;                 // オペランドを待っているコマンド（-1: なし）
+    bool at_end_;            // ソースがファイルの終端に達した
+
+    uint64_t wait_;          // 生成すべきサンプル数（1 / kVgmRate サンプル単位）
+    bool waited_;            // 前回ループしてからウェイトがあったか（ウェイトのないループで止まらないように）
+    uint16_t cmds_[kMaxCmds];
+    int cmd_num_;
+    bool finished_;
+    uint32_t stall_count_;
+
+    void restart(uint32_t offset);
+    bool nextChunk();
+    const uint8_t *fetch(int len);
+    void loopOrFinish();
+    bool handleNoData();
+    bool step(OPLL *opll);
+    void flush(OPLL *opll);
+    static int getOperandLength(uint8_t op);
+};
+
+#endif  // VGMPLAYER_H_
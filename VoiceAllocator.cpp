@@ -0,0 +1,312 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#include <string.h>
+
+#include "VoiceAllocator.h"
+
+VoiceAllocator::VoiceAllocator(int voice_num, int group_num) :
+    policy_(kPolicyPreferReleased), level_func_(nullptr), level_context_(nullptr) {
+    reset(voice_num, group_num);
+}
+
+void VoiceAllocator::reset(int voice_num, int group_num) {
+    if (voice_num < 0) {
+        voice_num = 0;
+    } else if (voice_num > kMaxVoices) {
+        voice_num = kMaxVoices;
+    }
+    if (group_num < 1) {
+        group_num = 1;
+    } else if (group_num > kMaxGroups) {
+        group_num = kMaxGroups;
+    }
+    voice_num_ = voice_num;
+    voice_limit_ = voice_num;
+    group_num_ = group_num;
+
+    key_on_list_.head = key_on_list_.tail = kNone;
+    for (int g = 0; g < kMaxGroups; g++) {
+        released_list_[g].head = released_list_[g].tail = kNone;
+        group_load_[g] = 0;
+    }
+    age_list_.head = age_list_.tail = kNone;
+    key_on_map_ = 0;
+    release_count_ = 0;
+    memset(note_map_, kNone, sizeof(note_map_));
+
+    // 最初は全ボイスがキーオフ済みで、番号の小さい順に使われる
+    for (int i = 0; i < voice_num_; i++) {
+        Voice &v = voices_[i];
+        v.same = kNone;
+        v.note = kNone;
+        v.channel = 0;
+        v.key_on = false;
+        v.released_at = 0;
+        pushBack(released_list_[getGroup(i)], &Voice::state, i);
+        pushBack(age_list_, &Voice::age, i);
+    }
+}
+
+void VoiceAllocator::setVoiceLimit(int limit) {
+    if (limit < 0) {
+        limit = 0;
+    } else if (limit > voice_num_) {
+        limit = voice_num_;
+    }
+
+    // 外れるボイスをリストから外す
+    for (int i = limit; i < voice_limit_; i++) {
+        Voice &v = voices_[i];
+        if (v.key_on) {
+            unlink(key_on_list_, &Voice::state, i);
+            group_load_[getGroup(i)]--;
+            key_on_map_ &= ~((uint64_t)1 << i);
+            v.key_on = false;
+        } else {
+            unlink(released_list_[getGroup(i)], &Voice::state, i);
+        }
+        unlink(age_list_, &Voice::age, i);
+        removeFromNoteMap(i);
+        v.note = kNone;
+    }
+
+    // 戻るボイスは鳴っていないので、最初に使われるように先頭につなぐ
+    for (int i = voice_limit_; i < limit; i++) {
+        Voice &v = voices_[i];
+        v.same = kNone;
+        v.note = kNone;
+        v.key_on = false;
+        v.released_at = 0;
+        pushFront(released_list_[getGroup(i)], &Voice::state, i);
+        pushFront(age_list_, &Voice::age, i);
+    }
+
+    voice_limit_ = limit;
+}
+
+bool VoiceAllocator::setPolicy(int policy) {
+    if (policy < 0 || kPolicyNum <= policy) {
+        return false;
+    }
+
+    policy_ = (Policy)policy;
+    return true;
+}
+
+void VoiceAllocator::setLevelFunc(LevelFunc func, void *context) {
+    level_func_ = func;
+    level_context_ = context;
+}
+
+void VoiceAllocator::unlink(List &list, Link Voice::*link, int voice) {
+    Link &l = voices_[voice].*link;
+
+    if (l.prev != kNone) {
+        (voices_[l.prev].*link).next = l.next;
+    } else {
+        list.head = l.next;
+    }
+
+    if (l.next != kNone) {
+        (voices_[l.next].*link).prev = l.prev;
+    } else {
+        list.tail = l.prev;
+    }
+
+    l.prev = l.next = kNone;
+}
+
+void VoiceAllocator::pushBack(List &list, Link Voice::*link, int voice) {
+    Link &l = voices_[voice].*link;
+
+    l.prev = list.tail;
+    l.next = kNone;
+    if (list.tail != kNone) {
+        (voices_[list.tail].*link).next = voice;
+    } else {
+        list.head = voice;
+    }
+    list.tail = voice;
+}
+
+void VoiceAllocator::pushFront(List &list, Link Voice::*link, int voice) {
+    Link &l = voices_[voice].*link;
+
+    l.prev = kNone;
+    l.next = list.head;
+    if (list.head != kNone) {
+        (voices_[list.head].*link).prev = voice;
+    } else {
+        list.tail = voice;
+    }
+    list.head = voice;
+}
+
+// ボイスが鳴らしていたノートを (channel, note) のつながりから外す
+// 同じノートを同時に鳴らしているボイスは通常ごく少数なので、たどる長さも短い
+void VoiceAllocator::removeFromNoteMap(int voice) {
+    Voice &v = voices_[voice];
+    if (v.note == kNone) {
+        return;
+    }
+
+    uint8_t *p = &note_map_[v.channel][v.note];
+    while (*p != kNone && *p != voice) {
+        p = &voices_[*p].same;
+    }
+    if (*p == voice) {
+        *p = v.same;
+    }
+    v.same = kNone;
+}
+
+// 音量が同じなら古いほうを選ぶ
+int VoiceAllocator::findQuietest(const List &list, int *min_level) const {
+    int found = kNone;
+    for (int i = list.head; i != kNone; i = voices_[i].state.next) {
+        int level = level_func_(i, level_context_);
+        if (found == kNone || level < *min_level) {
+            *min_level = level;
+            found = i;
+        }
+    }
+
+    return found;
+}
+
+// キーオン中のボイスが一番少ないグループの、一番古くキーオフしたボイス
+int VoiceAllocator::findReleased() const {
+    int found = kNone;
+    for (int g = 0; g < group_num_; g++) {
+        int head = released_list_[g].head;
+        if (head == kNone) {
+            continue;
+        }
+        if (found == kNone) {
+            found = head;
+            continue;
+        }
+
+        int load = group_load_[g];
+        int found_load = group_load_[getGroup(found)];
+        if (load < found_load ||
+            (load == found_load && (int32_t)(voices_[head].released_at - voices_[found].released_at) < 0)) {
+            found = head;
+        }
+    }
+
+    return found;
+}
+
+int VoiceAllocator::findQuietestReleased() const {
+    if (level_func_ == nullptr) {
+        return findReleased();
+    }
+
+    int found = kNone;
+    int min_level = 0;
+    for (int g = 0; g < group_num_; g++) {
+        int level = 0;
+        int voice = findQuietest(released_list_[g], &level);
+        if (voice != kNone && (found == kNone || level < min_level)) {
+            min_level = level;
+            found = voice;
+        }
+    }
+
+    return found;
+}
+
+int VoiceAllocator::selectVoice(uint8_t note, uint8_t channel) {
+    switch (policy_) {
+    case kPolicyOldest:
+        return age_list_.head;
+
+    case kPolicyQuietest: {
+        int voice = findQuietestReleased();
+        if (voice != kNone) {
+            return voice;
+        }
+        if (level_func_ == nullptr) {
+            return key_on_list_.head;
+        }
+        int level = 0;
+        return findQuietest(key_on_list_, &level);
+    }
+
+    case kPolicyRetrigger:
+        if (note_map_[channel][note] != kNone) {
+            return note_map_[channel][note];
+        }
+        // fall through
+
+    case kPolicyPreferReleased:
+    default: {
+        int voice = findReleased();
+        if (voice != kNone) {
+            return voice;
+        }
+        return key_on_list_.head;
+    }
+    }
+}
+
+int VoiceAllocator::noteOn(uint8_t note, uint8_t channel, bool *steal) {
+    if (voice_limit_ == 0 || note > 127 || channel > 15) {
+        return kInvalidVoice;
+    }
+
+    int voice = selectVoice(note, channel);
+    Voice &v = voices_[voice];
+
+    *steal = v.key_on;
+    if (v.key_on) {
+        unlink(key_on_list_, &Voice::state, voice);
+    } else {
+        unlink(released_list_[getGroup(voice)], &Voice::state, voice);
+        group_load_[getGroup(voice)]++;
+    }
+    unlink(age_list_, &Voice::age, voice);
+    removeFromNoteMap(voice);
+
+    v.note = note;
+    v.channel = channel;
+    v.key_on = true;
+    v.same = note_map_[channel][note];
+    note_map_[channel][note] = voice;
+
+    pushBack(key_on_list_, &Voice::state, voice);
+    pushBack(age_list_, &Voice::age, voice);
+    key_on_map_ |= (uint64_t)1 << voice;
+
+    return voice;
+}
+
+int VoiceAllocator::noteOff(uint8_t note, uint8_t channel) {
+    if (note > 127 || channel > 15) {
+        return kInvalidVoice;
+    }
+
+    // 同じノートが重ねて鳴らされている場合は、新しいほうからキーオフする
+    int voice = note_map_[channel][note];
+    while (voice != kNone && !voices_[voice].key_on) {
+        voice = voices_[voice].same;
+    }
+    if (voice == kNone) {
+        return kInvalidVoice;
+    }
+
+    Voice &v = voices_[voice];
+    v.key_on = false;
+    v.released_at = ++release_count_;
+    unlink(key_on_list_, &Voice::state, voice);
+    pushBack(released_list_[getGroup(voice)], &Voice::state, voice);
+    group_load_[getGroup(voice)]--;
+    key_on_map_ &= ~((uint64_t)1 << voice);
+
+    return voice;
+}
@@ -0,0 +1,119 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+#ifndef VOICEALLOCATOR_H_
+#define VOICEALLOCATOR_H_
+
+#include <stdint.h>
+
+// 発音チャンネル（ボイス）の割り当てを行う
+//
+// ボイスはキーオン中のリストとキーオフ済みのリストのどちらかにつながっている。
+// 前者はキーオンの古い順、後者はキーオフの古い順に並ぶ（侵入型の双方向リスト）。
+// これとは別に、全ボイスを Note On の古い順に並べたリストも持つ。
+// (MIDI チャンネル, ノート番号) からボイスを引く表を持つので、
+// Note On / Note Off ともにヒープを使わず O(1) で処理できる（kPolicyQuietest を除く）。
+//
+// ボイスはグループ（ボイス番号 % グループ数、FMTGSink では OPLL のチップ）に分けられ、
+// キーオフ済みのリストはグループごとに持つ。キーオフ済みのボイスを使うときは、
+// キーオン中のボイスが一番少ないグループから選ぶことで、負荷をグループ間で均等にする。
+class VoiceAllocator {
+public:
+    static const int kMaxVoices = 64;
+    static const int kMaxGroups = 8;
+    static const int kInvalidVoice = -1;
+
+    // 空きボイスがないときの乗っ取り方
+    enum Policy {
+        kPolicyOldest = 0,       // Note On が一番古いボイスを使う（キーオフ済みかどうかは問わない）
+        kPolicyQuietest,         // 一番音量の小さいボイスを使う（キーオフ済みを優先）
+        kPolicyPreferReleased,   // キーオフ済みで一番古いボイス、なければ一番古いキーオン中のボイス
+        kPolicyRetrigger,        // 同じノートを鳴らしたボイスがあれば再利用、なければ kPolicyPreferReleased
+        kPolicyNum
+    };
+
+    // ボイスの現在の音量を返す関数（大きいほど音量が大きい）
+    typedef int (*LevelFunc)(int voice, void *context);
+
+    explicit VoiceAllocator(int voice_num = 0, int group_num = 1);
+
+    void reset(int voice_num, int group_num = 1);
+
+    // ボイス 0 から limit - 1 だけを使う。外れるボイスはキーオンのままでも割り当てを解除するので、
+    // 呼び出す側で先にキーオフしておくこと
+    void setVoiceLimit(int limit);
+    int getVoiceLimit() const { return voice_limit_; }
+
+    bool setPolicy(int policy);
+    Policy getPolicy() const { return policy_; }
+    void setLevelFunc(LevelFunc func, void *context);
+
+    // Note On に使うボイスを返す。キーオン中のボイスを乗っ取った場合は *steal が true になる
+    int noteOn(uint8_t note, uint8_t channel, bool *steal);
+
+    // Note Off すべきボイスを返す。見つからなければ kInvalidVoice
+    int noteOff(uint8_t note, uint8_t channel);
+
+    int getVoiceNum() const { return voice_num_; }
+    int getGroupNum() const { return group_num_; }
+    int getGroup(int voice) const { return voice % group_num_; }
+    int getGroupLoad(int group) const { return group_load_[group]; }
+    bool isKeyOn(int voice) const { return voices_[voice].key_on; }
+    uint8_t getNote(int voice) const { return voices_[voice].note; }
+    uint8_t getChannel(int voice) const { return voices_[voice].channel; }
+
+    // キーオン中のボイスのビットマップ
+    uint64_t getKeyOnMap() const { return key_on_map_; }
+
+private:
+    static const uint8_t kNone = 0xff;
+
+    struct List {
+        uint8_t head;
+        uint8_t tail;
+    };
+
+    struct Link {
+        uint8_t prev;
+        uint8_t next;
+    };
+
+    struct Voice {
+        Link state;        // key_on_list_ または released_list_[グループ]
+        Link age;          // age_list_
+        uint8_t same;      // 同じ (channel, note) を鳴らした、一つ前のボイス
+        uint8_t note;      // kNone: 未使用
+        uint8_t channel;
+        bool key_on;
+        uint32_t released_at;  // キーオフした順番
+    };
+
+    Voice voices_[kMaxVoices];
+    List key_on_list_;
+    List released_list_[kMaxGroups];
+    List age_list_;
+    uint8_t group_load_[kMaxGroups];  // グループごとのキーオン中のボイス数
+    uint32_t release_count_;
+    uint8_t note_map_[16][128];  // (channel, note) -> 最後にそのノートを鳴らしたボイス（Voice::same でたどれる）
+    uint64_t key_on_map_;
+    int voice_num_;
+    int voice_limit_;
+    int group_num_;
+    Policy policy_;
+    LevelFunc level_func_;
+    void *level_context_;
+
+    void unlink(List &list, Link Voice::*link, int voice);
+    void pushBack(List &list, Link Voice::*link, int voice);
+    void pushFront(List &list, Link Voice::*link, int voice);
+    void removeFromNoteMap(int voice);
+    int findQuietest(const List &list, int *min_level) const;
+    int findReleased() const;
+    int findQuietestReleased() const;
+    int selectVoice(uint8_t note, uint8_t channel);
+};
+
+#endif  // VOICEALLOCATOR_H_
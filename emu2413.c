@@ -16,6 +16,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if !defined(OPLL_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define OPLL_USE_NEON 1
+#elif !defined(OPLL_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define OPLL_USE_SSE2 1
+#endif
+
 #ifndef INLINE
 #if defined(_MSC_VER)
 #define INLINE __inline
@@ -30,7 +38,7 @@
 
 #define OPLL_TONE_NUM 3
 /* clang-format off */
-static uint8_t default_inst[OPLL_TONE_NUM][(16 + 3) * 8] = {{
+static const uint8_t default_inst[OPLL_TONE_NUM][(16 + 3) * 8] = {{
 0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 0: User
 0x71,0x61,0x1e,0x17,0xd0,0x78,0x00,0x17, // 1: Violin
 0x13,0x41,0x1a,0x0d,0xd8,0xf7,0x23,0x13, // 2: Guitar
@@ -123,53 +131,13 @@ static uint8_t default_inst[OPLL_TONE_NUM][(16 + 3) * 8] = {{
 #define PG_BITS 10 /* 2^10 = 1024 length sine table */
 #define PG_WIDTH (1 << PG_BITS)
 
-/* clang-format off */
-/* exp_table[x] = round((exp2((double)x / 256.0) - 1) * 1024) */
-static uint16_t exp_table[256] = {
-0,    3,    6,    8,    11,   14,   17,   20,   22,   25,   28,   31,   34,   37,   40,   42,
-45,   48,   51,   54,   57,   60,   63,   66,   69,   72,   75,   78,   81,   84,   87,   90,
-93,   96,   99,   102,  105,  108,  111,  114,  117,  120,  123,  126,  130,  133,  136,  139,
-142,  145,  148,  152,  155,  158,  161,  164,  168,  171,  174,  177,  181,  184,  187,  190,
-194,  197,  200,  204,  207,  210,  214,  217,  220,  224,  227,  231,  234,  237,  241,  244,
-248,  251,  255,  258,  262,  265,  268,  272,  276,  279,  283,  286,  290,  293,  297,  300,
-304,  308,  311,  315,  318,  322,  326,  329,  333,  337,  340,  344,  348,  352,  355,  359,
-363,  367,  370,  374,  378,  382,  385,  389,  393,  397,  401,  405,  409,  412,  416,  420,
-424,  428,  432,  436,  440,  444,  448,  452,  456,  460,  464,  468,  472,  476,  480,  484,
-488,  492,  496,  501,  505,  509,  513,  517,  521,  526,  530,  534,  538,  542,  547,  551,
-555,  560,  564,  568,  572,  577,  581,  585,  590,  594,  599,  603,  607,  612,  616,  621,
-625,  630,  634,  639,  643,  648,  652,  657,  661,  666,  670,  675,  680,  684,  689,  693,
-698,  703,  708,  712,  717,  722,  726,  731,  736,  741,  745,  750,  755,  760,  765,  770,
-774,  779,  784,  789,  794,  799,  804,  809,  814,  819,  824,  829,  834,  839,  844,  849,
-854,  859,  864,  869,  874,  880,  885,  890,  895,  900,  906,  911,  916,  921,  927,  932,
-937,  942,  948,  953,  959,  964,  969,  975,  980,  986,  991,  996, 1002, 1007, 1013, 1018
-};
-/* fullsin_table[x] = round(-log2(sin((x + 0.5) * PI / (PG_WIDTH / 4) / 2)) * 256) */
-static uint16_t fullsin_table[PG_WIDTH] = {
-2137, 1731, 1543, 1419, 1326, 1252, 1190, 1137, 1091, 1050, 1013, 979,  949,  920,  894,  869, 
-846,  825,  804,  785,  767,  749,  732,  717,  701,  687,  672,  659,  646,  633,  621,  609, 
-598,  587,  576,  566,  556,  546,  536,  527,  518,  509,  501,  492,  484,  476,  468,  461,
-453,  446,  439,  432,  425,  418,  411,  405,  399,  392,  386,  380,  375,  369,  363,  358,  
-352,  347,  341,  336,  331,  326,  321,  316,  311,  307,  302,  297,  293,  289,  284,  280,
-276,  271,  267,  263,  259,  255,  251,  248,  244,  240,  236,  233,  229,  226,  222,  219, 
-215,  212,  209,  205,  202,  199,  196,  193,  190,  187,  184,  181,  178,  175,  172,  169, 
-167,  164,  161,  159,  156,  153,  151,  148,  146,  143,  141,  138,  136,  134,  131,  129,  
-127,  125,  122,  120,  118,  116,  114,  112,  110,  108,  106,  104,  102,  100,  98,   96,   
-94,   92,   91,   89,   87,   85,   83,   82,   80,   78,   77,   75,   74,   72,   70,   69,
-67,   66,   64,   63,   62,   60,   59,   57,   56,   55,   53,   52,   51,   49,   48,   47,  
-46,   45,   43,   42,   41,   40,   39,   38,   37,   36,   35,   34,   33,   32,   31,   30,  
-29,   28,   27,   26,   25,   24,   23,   23,   22,   21,   20,   20,   19,   18,   17,   17,   
-16,   15,   15,   14,   13,   13,   12,   12,   11,   10,   10,   9,    9,    8,    8,    7,    
-7,    7,    6,    6,    5,    5,    5,    4,    4,    4,    3,    3,    3,    2,    2,    2,
-2,    1,    1,    1,    1,    1,    1,    1,    0,    0,    0,    0,    0,    0,    0,    0,
-};
-/* clang-format on */
+#include "emu2413_tables.h"
 
-static uint16_t halfsin_table[PG_WIDTH];
-static uint16_t *wave_table_map[2] = {fullsin_table, halfsin_table};
+static const uint16_t *const wave_table_map[2] = {fullsin_table, halfsin_table};
 
 /* pitch modulator */
 /* offset to fnum, rough approximation of 14 cents depth. */
-static int8_t pm_table[8][8] = {
+static const int8_t pm_table[8][8] = {
     {0, 0, 0, 0, 0, 0, 0, 0},    // fnum = 000xxxxxx
     {0, 0, 1, 0, 0, 0, -1, 0},   // fnum = 001xxxxxx
     {0, 1, 2, 1, 0, -1, -2, -1}, // fnum = 010xxxxxx
@@ -183,7 +151,7 @@ static int8_t pm_table[8][8] = {
 /* amplitude lfo table */
 /* The following envelop pattern is verified on real YM2413. */
 /* each element repeates 64 cycles */
-static uint8_t am_table[210] = {0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  1,  1,  1,  1,  1,  1,  //
+static const uint8_t am_table[210] = {0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  1,  1,  1,  1,  1,  1,  //
                                 2,  2,  2,  2,  2,  2,  2,  2,  3,  3,  3,  3,  3,  3,  3,  3,  //
                                 4,  4,  4,  4,  4,  4,  4,  4,  5,  5,  5,  5,  5,  5,  5,  5,  //
                                 6,  6,  6,  6,  6,  6,  6,  6,  7,  7,  7,  7,  7,  7,  7,  7,  //
@@ -201,7 +169,7 @@ static uint8_t am_table[210] = {0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  1,  1,
 
 /* envelope decay increment step table */
 /* based on andete's research */
-static uint8_t eg_step_tables[4][8] = {
+static const uint8_t eg_step_tables[4][8] = {
     {0, 1, 0, 1, 0, 1, 0, 1},
     {0, 1, 0, 1, 1, 1, 0, 1},
     {0, 1, 1, 1, 0, 1, 1, 1},
@@ -210,19 +178,10 @@ static uint8_t eg_step_tables[4][8] = {
 
 enum __OPLL_EG_STATE { ATTACK, DECAY, SUSTAIN, RELEASE, DAMP, UNKNOWN };
 
-static uint32_t ml_table[16] = {1,     1 * 2, 2 * 2,  3 * 2,  4 * 2,  5 * 2,  6 * 2,  7 * 2,
-                                8 * 2, 9 * 2, 10 * 2, 10 * 2, 12 * 2, 12 * 2, 15 * 2, 15 * 2};
+static const uint32_t ml_table[16] = {1,     1 * 2, 2 * 2,  3 * 2,  4 * 2,  5 * 2,  6 * 2,  7 * 2,
+                                      8 * 2, 9 * 2, 10 * 2, 10 * 2, 12 * 2, 12 * 2, 15 * 2, 15 * 2};
 
-#define dB2(x) ((x)*2)
-static double kl_table[16] = {dB2(0.000),  dB2(9.000),  dB2(12.000), dB2(13.875), dB2(15.000), dB2(16.125),
-                              dB2(16.875), dB2(17.625), dB2(18.000), dB2(18.750), dB2(19.125), dB2(19.500),
-                              dB2(19.875), dB2(20.250), dB2(20.625), dB2(21.000)};
-
-static uint32_t tll_table[8 * 16][1 << TL_BITS][4];
-static int32_t rks_table[8 * 2][2];
-
-static OPLL_PATCH null_patch = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-static OPLL_PATCH default_patch[OPLL_TONE_NUM][(16 + 3) * 2];
+static const OPLL_PATCH null_patch = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
 /* don't forget min/max is defined as a macro in stdlib.h of Visual C. */
 #ifndef min
@@ -244,176 +203,166 @@ static INLINE int max(int i, int j) {
 /* Note: to disable internal rate converter, set clock/72 to output sampling rate. */
 
 /*
- * LW is truncate length of sinc(x) calculation.
+ * The converter is an integer polyphase FIR filter.
+ * LW is the number of taps per output sample (the truncate length of sinc(x)).
  * Lower LW is faster, higher LW results better quality.
- * LW must be a non-zero positive even number, no upper limit.
+ * LW must be a power of two since the history buffer is circular.
  * LW=16 or greater is recommended when upsampling.
  * LW=8 is practically okay for downsampling.
  */
 #define LW 16
 
-/* resolution of sinc(x) table. sinc(x) where 0.0<=x<1.0 corresponds to sinc_table[0...SINC_RESO-1] */
-#define SINC_RESO 256
-#define SINC_AMP_BITS 12
+/* number of filter phases between two input samples. must be a power of two. */
+#define CONV_PHASE_BITS 8
+#define CONV_PHASE_NUM (1 << CONV_PHASE_BITS)
+
+/* coefficients are Q14 fixed point, every phase row sums up to 1 << CONV_AMP_BITS */
+#define CONV_AMP_BITS 14
 
 // double hamming(double x) { return 0.54 - 0.46 * cos(2 * PI * x); }
 static double blackman(double x) { return 0.42 - 0.5 * cos(2 * _PI_ * x) + 0.08 * cos(4 * _PI_ * x); }
 static double sinc(double x) { return (x == 0.0 ? 1.0 : sin(_PI_ * x) / (_PI_ * x)); }
 static double windowed_sinc(double x) { return blackman(0.5 + 0.5 * x / (LW / 2)) * sinc(x); }
 
-/* f_inp: input frequency. f_out: output frequencey, ch: number of channels */
-OPLL_RateConv *OPLL_RateConv_new(double f_inp, double f_out, int ch) {
+static uint32_t gcd(uint32_t a, uint32_t b) {
+  while (b) {
+    uint32_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/*
+ * f_inp: input frequency. f_out: output frequency, ch: number of channels
+ * Only the ratio f_inp / f_out matters, so both may be scaled by a common factor (e.g. clk and rate * 72).
+ */
+OPLL_RateConv *OPLL_RateConv_new(uint32_t f_inp, uint32_t f_out, int ch) {
   OPLL_RateConv *conv = malloc(sizeof(OPLL_RateConv));
-  int i;
+  const double f_ratio = (double)f_inp / f_out;
+  const uint32_t g = gcd(f_inp, f_out);
+  int i, k;
 
   conv->ch = ch;
-  conv->f_ratio = f_inp / f_out;
-  conv->buf = malloc(sizeof(void *) * ch);
-  for (i = 0; i < ch; i++) {
-    conv->buf[i] = malloc(sizeof(conv->buf[0][0]) * LW);
-  }
-
-  /* create sinc_table for positive 0 <= x < LW/2 */
-  conv->sinc_table = malloc(sizeof(conv->sinc_table[0]) * SINC_RESO * LW / 2);
-  for (i = 0; i < SINC_RESO * LW / 2; i++) {
-    const double x = (double)i / SINC_RESO;
-    if (f_out < f_inp) {
-      /* for downsampling */
-      conv->sinc_table[i] = (int16_t)((1 << SINC_AMP_BITS) * windowed_sinc(x / conv->f_ratio) / conv->f_ratio);
-    } else {
-      /* for upsampling */
-      conv->sinc_table[i] = (int16_t)((1 << SINC_AMP_BITS) * windowed_sinc(x));
+  conv->den = f_out / g;
+  conv->step_q = (uint32_t)(((uint64_t)(f_inp / g) << CONV_PHASE_BITS) / conv->den);
+  conv->step_r = (uint32_t)(((uint64_t)(f_inp / g) << CONV_PHASE_BITS) % conv->den);
+
+  /* history of each channel. every sample is written twice so that LW samples are always contiguous. */
+  conv->buf = malloc(sizeof(conv->buf[0]) * LW * 2 * ch);
+
+  /*
+   * conv->coef[q * LW + k] is the weight of the k-th oldest sample when the output lies q/CONV_PHASE_NUM
+   * after the (LW/2-1)-th oldest sample.
+   */
+  conv->coef = malloc(sizeof(conv->coef[0]) * LW * CONV_PHASE_NUM);
+  for (i = 0; i < CONV_PHASE_NUM; i++) {
+    int16_t *row = &conv->coef[i * LW];
+    double w[LW], sum = 0;
+    int32_t isum = 0;
+
+    for (k = 0; k < LW; k++) {
+      const double x = (k - (LW / 2 - 1)) - (double)i / CONV_PHASE_NUM;
+      if (f_inp > f_out) {
+        /* for downsampling */
+        w[k] = windowed_sinc(x / f_ratio) / f_ratio;
+      } else {
+        /* for upsampling */
+        w[k] = windowed_sinc(x);
+      }
+      sum += w[k];
+    }
+    /* normalize so that the DC gain does not depend on the phase */
+    for (k = 0; k < LW; k++) {
+      row[k] = (int16_t)floor(w[k] / sum * (1 << CONV_AMP_BITS) + 0.5);
+      isum += row[k];
     }
+    row[LW / 2 - 1 + (i >= CONV_PHASE_NUM / 2)] += (int16_t)((1 << CONV_AMP_BITS) - isum);
   }
 
-  return conv;
-}
+  OPLL_RateConv_reset(conv);
 
-static INLINE int16_t lookup_sinc_table(int16_t *table, double x) {
-  int16_t index = (int16_t)(x * SINC_RESO);
-  if (index < 0)
-    index = -index;
-  return table[min(SINC_RESO * LW / 2 - 1, index)];
+  return conv;
 }
 
 void OPLL_RateConv_reset(OPLL_RateConv *conv) {
-  int i;
-  conv->timer = 0;
-  for (i = 0; i < conv->ch; i++) {
-    memset(conv->buf[i], 0, sizeof(conv->buf[i][0]) * LW);
-  }
+  conv->pos = 0;
+  conv->phase_q = 0;
+  conv->phase_r = 0;
+  memset(conv->buf, 0, sizeof(conv->buf[0]) * LW * 2 * conv->ch);
 }
 
 /* put original data to this converter at f_inp. */
+/* the history advances at the call for ch 0, so call it for ch 0 first when more than one channel is used. */
 void OPLL_RateConv_putData(OPLL_RateConv *conv, int ch, int16_t data) {
-  int16_t *buf = conv->buf[ch];
-  int i;
-  for (i = 0; i < LW - 1; i++) {
-    buf[i] = buf[i + 1];
+  int16_t *buf = &conv->buf[ch * LW * 2];
+  uint32_t w;
+  if (ch == 0) {
+    conv->pos = (conv->pos + 1) & (LW - 1);
   }
-  buf[LW - 1] = data;
+  /* the oldest sample is at buf[pos] and the newest one is at buf[pos + LW - 1] */
+  w = (conv->pos + LW - 1) & (LW - 1);
+  buf[w] = data;
+  buf[w + LW] = data;
 }
 
-/* get resampled data from this converter at f_out. */
-/* this function must be called f_out / f_inp times per one putData call. */
-int16_t OPLL_RateConv_getData(OPLL_RateConv *conv, int ch) {
-  int16_t *buf = conv->buf[ch];
-  int32_t sum = 0;
+static INLINE int32_t dot_product(const int16_t *x, const int16_t *h) {
+#if defined(OPLL_USE_NEON)
+  int32x4_t acc = vmull_s16(vld1_s16(x), vld1_s16(h));
   int k;
-  double dn;
-  conv->timer += conv->f_ratio;
-  dn = conv->timer - floor(conv->timer);
-  conv->timer = dn;
-
-  for (k = 0; k < LW; k++) {
-    double x = ((double)k - (LW / 2 - 1)) - dn;
-    sum += buf[k] * lookup_sinc_table(conv->sinc_table, x);
+  for (k = 4; k < LW; k += 4) {
+    acc = vmlal_s16(acc, vld1_s16(x + k), vld1_s16(h + k));
   }
-  return sum >> SINC_AMP_BITS;
-}
-
-void OPLL_RateConv_delete(OPLL_RateConv *conv) {
-  int i;
-  for (i = 0; i < conv->ch; i++) {
-    free(conv->buf[i]);
-  }
-  free(conv->buf);
-  free(conv->sinc_table);
-  free(conv);
-}
-
-/***************************************************
-
-                  Create tables
-
-****************************************************/
-
-static void makeSinTable(void) {
-  int x;
-
-  for (x = 0; x < PG_WIDTH / 4; x++) {
-    fullsin_table[PG_WIDTH / 4 + x] = fullsin_table[PG_WIDTH / 4 - x - 1];
+  return vgetq_lane_s32(acc, 0) + vgetq_lane_s32(acc, 1) + vgetq_lane_s32(acc, 2) + vgetq_lane_s32(acc, 3);
+#elif defined(OPLL_USE_SSE2)
+  __m128i acc = _mm_setzero_si128();
+  int k;
+  for (k = 0; k < LW; k += 8) {
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(x + k)),
+                                            _mm_loadu_si128((const __m128i *)(h + k))));
   }
-
-  for (x = 0; x < PG_WIDTH / 2; x++) {
-    fullsin_table[PG_WIDTH / 2 + x] = 0x8000 | fullsin_table[x];
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(acc);
+#else
+  int32_t sum = 0;
+  int k;
+  for (k = 0; k < LW; k++) {
+    sum += x[k] * h[k];
   }
-
-  for (x = 0; x < PG_WIDTH / 2; x++)
-    halfsin_table[x] = fullsin_table[x];
-
-  for (x = PG_WIDTH / 2; x < PG_WIDTH; x++)
-    halfsin_table[x] = 0xfff;
+  return sum;
+#endif
 }
 
-static void makeTllTable(void) {
-
-  int32_t tmp;
-  int32_t fnum, block, TL, KL;
+/* get resampled data from this converter at f_out. */
+/* this function must be called f_out / f_inp times per one putData call. */
+/* the phase advances at the call for ch 0, so call it for ch 0 first when more than one channel is used. */
+int16_t OPLL_RateConv_getData(OPLL_RateConv *conv, int ch) {
+  int32_t sum;
 
-  for (fnum = 0; fnum < 16; fnum++) {
-    for (block = 0; block < 8; block++) {
-      for (TL = 0; TL < 64; TL++) {
-        for (KL = 0; KL < 4; KL++) {
-          if (KL == 0) {
-            tll_table[(block << 4) | fnum][TL][KL] = TL2EG(TL);
-          } else {
-            tmp = (int32_t)(kl_table[fnum] - dB2(3.000) * (7 - block));
-            if (tmp <= 0)
-              tll_table[(block << 4) | fnum][TL][KL] = TL2EG(TL);
-            else
-              tll_table[(block << 4) | fnum][TL][KL] = (uint32_t)((tmp >> (3 - KL)) / EG_STEP) + TL2EG(TL);
-          }
-        }
-      }
+  if (ch == 0) {
+    conv->phase_r += conv->step_r;
+    if (conv->phase_r >= conv->den) {
+      conv->phase_r -= conv->den;
+      conv->phase_q++;
     }
+    conv->phase_q = (conv->phase_q + conv->step_q) & (CONV_PHASE_NUM - 1);
   }
-}
-
-static void makeRksTable(void) {
-  int fnum8, block;
-  for (fnum8 = 0; fnum8 < 2; fnum8++)
-    for (block = 0; block < 8; block++) {
-      rks_table[(block << 1) | fnum8][1] = (block << 1) + fnum8;
-      rks_table[(block << 1) | fnum8][0] = block >> 1;
-    }
-}
 
-static void makeDefaultPatch() {
-  int i, j;
-  for (i = 0; i < OPLL_TONE_NUM; i++)
-    for (j = 0; j < 19; j++)
-      OPLL_getDefaultPatch(i, j, &default_patch[i][j * 2]);
+  sum = dot_product(&conv->buf[ch * LW * 2 + conv->pos], &conv->coef[conv->phase_q * LW]);
+  sum = (sum + (1 << (CONV_AMP_BITS - 1))) >> CONV_AMP_BITS;
+  if (sum > 32767) {
+    return 32767;
+  } else if (sum < -32768) {
+    return -32768;
+  }
+  return (int16_t)sum;
 }
 
-static uint8_t table_initialized = 0;
-
-static void initializeTables() {
-  makeTllTable();
-  makeRksTable();
-  makeSinTable();
-  makeDefaultPatch();
-  table_initialized = 1;
+void OPLL_RateConv_delete(OPLL_RateConv *conv) {
+  free(conv->buf);
+  free(conv->coef);
+  free(conv);
 }
 
 /*********************************************************
@@ -433,9 +382,27 @@ static void initializeTables() {
 #define CAR(o, x) (&(o)->slot[((x) << 1) | 1])
 #define BIT(s, b) (((s) >> (b)) & 1)
 
+#if OPLL_PROFILE
+static uint32_t profile_zero(void) { return 0; }
+static uint32_t (*profile_counter)(void) = profile_zero;
+
+/* start counting from here */
+#define PROFILE_MARK(o) ((o)->profile_mark = profile_counter())
+/* add the count since the last mark or lap to the stage */
+#define PROFILE_LAP(o, stage)                                                                                          \
+  do {                                                                                                                 \
+    const uint32_t now_ = profile_counter();                                                                           \
+    (o)->profile[stage] += now_ - (o)->profile_mark;                                                                   \
+    (o)->profile_mark = now_;                                                                                          \
+  } while (0)
+#else
+#define PROFILE_MARK(o) ((void)0)
+#define PROFILE_LAP(o, stage) ((void)0)
+#endif
+
 #if OPLL_DEBUG
 static void _debug_print_patch(OPLL_SLOT *slot) {
-  OPLL_PATCH *p = slot->patch;
+  const OPLL_PATCH *p = slot->patch;
   printf("[slot#%d am:%d pm:%d eg:%d kr:%d ml:%d kl:%d tl:%d ws:%d fb:%d A:%d D:%d S:%d R:%d]\n", slot->number, //
          p->AM, p->PM, p->EG, p->KR, p->ML,                                                                     //
          p->KL, p->TL, p->WS, p->FB,                                                                            //
@@ -506,7 +473,23 @@ enum SLOT_UPDATE_FLAG {
 
 static INLINE void request_update(OPLL_SLOT *slot, int flag) { slot->update_requests |= flag; }
 
-static void commit_slot_update(OPLL_SLOT *slot) {
+static INLINE uint32_t calc_pg_inc(OPLL_SLOT *slot, int32_t pm_step) {
+  const int8_t pm = slot->patch->PM ? pm_table[(slot->fnum >> 6) & 7][pm_step] : 0;
+  return (((slot->fnum & 0x1ff) * 2 + pm) * ml_table[slot->patch->ML]) << slot->blk >> 2;
+}
+
+/*
+ * refresh the lane values derived from fnum, blk and the patch.
+ * Patch parameters take effect immediately, so this is also called whenever the patch of a slot is changed.
+ */
+static INLINE void update_slot_lanes(OPLL *opll, OPLL_SLOT *slot) {
+  OPLL_SLOT_LANES *lanes = &opll->lanes;
+  lanes->pg_inc[slot->number] = calc_pg_inc(slot, lanes->pm_step & 7);
+  /* single slot rhythm instruments are not affected by am */
+  lanes->am_mask[slot->number] = (slot->patch->AM && !(slot->type & 2)) ? 0xffff : 0;
+}
+
+static void commit_slot_update(OPLL *opll, OPLL_SLOT *slot) {
 
 #if OPLL_DEBUG
   if (slot->last_eg_state != slot->eg_state) {
@@ -515,15 +498,17 @@ static void commit_slot_update(OPLL_SLOT *slot) {
   }
 #endif
 
+  update_slot_lanes(opll, slot);
+
   if (slot->update_requests & UPDATE_WS) {
     slot->wave_table = wave_table_map[slot->patch->WS];
   }
 
   if (slot->update_requests & UPDATE_TLL) {
     if ((slot->type & 1) == 0) {
-      slot->tll = tll_table[slot->blk_fnum >> 5][slot->patch->TL][slot->patch->KL];
+      opll->lanes.tll[slot->number] = TL2EG(slot->patch->TL) + ksl_table[slot->blk_fnum >> 5][slot->patch->KL];
     } else {
-      slot->tll = tll_table[slot->blk_fnum >> 5][slot->volume][slot->patch->KL];
+      opll->lanes.tll[slot->number] = TL2EG(slot->volume) + ksl_table[slot->blk_fnum >> 5][slot->patch->KL];
     }
   }
 
@@ -553,26 +538,31 @@ static void commit_slot_update(OPLL_SLOT *slot) {
   slot->update_requests = 0;
 }
 
-static void reset_slot(OPLL_SLOT *slot, int number) {
+static void reset_slot(OPLL *opll, OPLL_SLOT *slot, int number) {
+  OPLL_SLOT_LANES *lanes = &opll->lanes;
   slot->number = number;
   slot->type = number % 2;
   slot->pg_keep = 0;
   slot->wave_table = wave_table_map[0];
-  slot->pg_phase = 0;
+  lanes->pg_phase[number] = 0;
+  lanes->pg_inc[number] = 0;
+  lanes->pg_out[number] = 0;
+  lanes->eg_out[number] = EG_MUTE;
+  lanes->tll[number] = 0;
+  lanes->am_mask[number] = 0;
+  lanes->att[number] = 0xffff;
   slot->output[0] = 0;
   slot->output[1] = 0;
   slot->eg_state = RELEASE;
   slot->eg_shift = 0;
+  slot->eg_next = opll->eg_counter;
   slot->rks = 0;
-  slot->tll = 0;
   slot->key_flag = 0;
   slot->sus_flag = 0;
   slot->blk_fnum = 0;
   slot->blk = 0;
   slot->fnum = 0;
   slot->volume = 0;
-  slot->pg_out = 0;
-  slot->eg_out = EG_MUTE;
   slot->patch = &null_patch;
 }
 
@@ -581,6 +571,7 @@ static INLINE void slotOn(OPLL *opll, int i) {
   slot->key_flag = 1;
   slot->eg_state = DAMP;
   request_update(slot, UPDATE_EG);
+  opll->active_ch |= 1 << (i >> 1);
 }
 
 static INLINE void slotOff(OPLL *opll, int i) {
@@ -641,10 +632,32 @@ static INLINE void set_patch(OPLL *opll, int32_t ch, int32_t num) {
   opll->patch_number[ch] = num;
   MOD(opll, ch)->patch = &opll->patch[num * 2 + 0];
   CAR(opll, ch)->patch = &opll->patch[num * 2 + 1];
+  update_slot_lanes(opll, MOD(opll, ch));
+  update_slot_lanes(opll, CAR(opll, ch));
   request_update(MOD(opll, ch), UPDATE_ALL);
   request_update(CAR(opll, ch), UPDATE_ALL);
 }
 
+/*
+ * make every slot run calc_envelope() from the next sample on. Called whenever the registers, patches or the set
+ * of calculated channels change, so that a skipped slot never misses a change which is not announced by
+ * request_update().
+ */
+static void wake_envelopes(OPLL *opll) {
+  int i;
+  for (i = 0; i < 18; i++) {
+    opll->slot[i].eg_next = opll->eg_counter;
+  }
+}
+
+static void update_all_slot_lanes(OPLL *opll) {
+  int i;
+  for (i = 0; i < 18; i++) {
+    update_slot_lanes(opll, &opll->slot[i]);
+  }
+  wake_envelopes(opll);
+}
+
 static INLINE void set_sus_flag(OPLL *opll, int ch, int flag) {
   CAR(opll, ch)->sus_flag = flag;
   request_update(CAR(opll, ch), UPDATE_EG);
@@ -722,30 +735,52 @@ static INLINE void update_rhythm_mode(OPLL *opll) {
   opll->rhythm_mode = new_rhythm_mode;
 }
 
-static void update_ampm(OPLL *opll) {
+/*
+ * The AM level only changes every 64 samples (and the PM step every 1024, see update_slots), so in normal
+ * operation the table index is stepped and wrapped at those boundaries instead of taking the modulo every sample.
+ * The test register (reset / speed-up of the LFOs) takes the general path and resynchronizes the index.
+ */
+static INLINE void update_ampm(OPLL *opll) {
+  if (!(opll->test_flag & (2 | 8))) {
+    opll->pm_phase++;
+    if ((++opll->am_phase & 63) == 0) {
+      if (++opll->am_index == sizeof(am_table)) {
+        opll->am_index = 0;
+      }
+      opll->lfo_am = am_table[opll->am_index];
+    }
+    return;
+  }
+
   if (opll->test_flag & 2) {
     opll->pm_phase = 0;
     opll->am_phase = 0;
   } else {
-    opll->pm_phase += (opll->test_flag & 8) ? 1024 : 1;
-    opll->am_phase += (opll->test_flag & 8) ? 64 : 1;
+    opll->pm_phase += 1024;
+    opll->am_phase += 64;
   }
-  opll->lfo_am = am_table[(opll->am_phase >> 6) % sizeof(am_table)];
+  opll->am_index = (opll->am_phase >> 6) % sizeof(am_table);
+  opll->lfo_am = am_table[opll->am_index];
 }
 
-static void update_noise(OPLL *opll, int cycle) {
-  int i;
-  for (i = 0; i < cycle; i++) {
-    if (opll->noise & 1) {
-      opll->noise ^= 0x800200;
-    }
-    opll->noise >>= 1;
+/*
+ * Advance the 23-bit noise LFSR by cycle steps. One step is
+ *   noise = (noise >> 1) ^ ((noise & 1) ? 0x400100 : 0)
+ * The bits fed back into bit 22 and bit 8 take at least 9 steps to reach bit 0, so for up to 9 steps the
+ * feedback bits are just the low bits of the current value and all steps are applied with a few word operations.
+ */
+static INLINE void update_noise(OPLL *opll, int cycle) {
+  while (cycle > 0) {
+    const int k = cycle < 9 ? cycle : 9;
+    const uint32_t fb = opll->noise & ((1 << k) - 1);
+    opll->noise = (opll->noise >> k) ^ (((fb << 22) | (fb << 8)) >> (k - 1));
+    cycle -= k;
   }
 }
 
 static void update_short_noise(OPLL *opll) {
-  const uint32_t pg_hh = opll->slot[SLOT_HH].pg_out;
-  const uint32_t pg_cym = opll->slot[SLOT_CYM].pg_out;
+  const uint32_t pg_hh = opll->lanes.pg_out[SLOT_HH];
+  const uint32_t pg_cym = opll->lanes.pg_out[SLOT_CYM];
 
   const uint8_t h_bit2 = BIT(pg_hh, PG_BITS - 8);
   const uint8_t h_bit7 = BIT(pg_hh, PG_BITS - 3);
@@ -757,14 +792,46 @@ static void update_short_noise(OPLL *opll) {
   opll->short_noise = (h_bit2 ^ h_bit7) | (h_bit3 ^ c_bit5) | (c_bit3 ^ c_bit5);
 }
 
-static INLINE void calc_phase(OPLL_SLOT *slot, int32_t pm_phase, uint8_t reset) {
-  const int8_t pm = slot->patch->PM ? pm_table[(slot->fnum >> 6) & 7][(pm_phase >> 10) & 7] : 0;
+/* advance the phase of slot 0 to num - 1 */
+static INLINE void calc_phase(OPLL_SLOT_LANES *lanes, int num, uint8_t reset) {
+  uint32_t *phase = lanes->pg_phase;
+  const uint32_t *inc = lanes->pg_inc;
+  uint32_t *out = lanes->pg_out;
+  int i = 0;
+
   if (reset) {
-    slot->pg_phase = 0;
+    for (i = 0; i < num; i++) {
+      phase[i] = inc[i] & (DP_WIDTH - 1);
+      out[i] = phase[i] >> DP_BASE_BITS;
+    }
+    return;
+  }
+
+#if defined(OPLL_USE_NEON)
+  {
+    const uint32x4_t width_mask = vdupq_n_u32(DP_WIDTH - 1);
+    for (; i + 4 <= num; i += 4) {
+      uint32x4_t p = vandq_u32(vaddq_u32(vld1q_u32(phase + i), vld1q_u32(inc + i)), width_mask);
+      vst1q_u32(phase + i, p);
+      vst1q_u32(out + i, vshrq_n_u32(p, DP_BASE_BITS));
+    }
+  }
+#elif defined(OPLL_USE_SSE2)
+  {
+    const __m128i width_mask = _mm_set1_epi32(DP_WIDTH - 1);
+    for (; i + 4 <= num; i += 4) {
+      __m128i p = _mm_loadu_si128((const __m128i *)(phase + i));
+      p = _mm_and_si128(_mm_add_epi32(p, _mm_loadu_si128((const __m128i *)(inc + i))), width_mask);
+      _mm_storeu_si128((__m128i *)(phase + i), p);
+      _mm_storeu_si128((__m128i *)(out + i), _mm_srli_epi32(p, DP_BASE_BITS));
+    }
+  }
+#endif
+
+  for (; i < num; i++) {
+    phase[i] = (phase[i] + inc[i]) & (DP_WIDTH - 1);
+    out[i] = phase[i] >> DP_BASE_BITS;
   }
-  slot->pg_phase += (((slot->fnum & 0x1ff) * 2 + pm) * ml_table[slot->patch->ML]) << slot->blk >> 2;
-  slot->pg_phase &= (DP_WIDTH - 1);
-  slot->pg_out = slot->pg_phase >> DP_BASE_BITS;
 }
 
 static INLINE uint8_t lookup_attack_step(OPLL_SLOT *slot, uint32_t counter) {
@@ -809,59 +876,112 @@ static INLINE uint8_t lookup_decay_step(OPLL_SLOT *slot, uint32_t counter) {
   }
 }
 
-static INLINE void start_envelope(OPLL_SLOT *slot) {
+static INLINE void start_envelope(OPLL_SLOT *slot, uint16_t *eg_out) {
   if (min(15, slot->patch->AR + (slot->rks >> 2)) == 15) {
     slot->eg_state = DECAY;
-    slot->eg_out = 0;
+    *eg_out = 0;
   } else {
     slot->eg_state = ATTACK;
-    slot->eg_out = EG_MUTE;
+    *eg_out = EG_MUTE;
   }
   request_update(slot, UPDATE_EG);
 }
 
-static INLINE void calc_envelope(OPLL_SLOT *slot, OPLL_SLOT *buddy, uint16_t eg_counter, uint8_t test) {
+/* far enough ahead to mean "never" for the wrap-safe comparison in update_slots() */
+#define EG_NEXT_NEVER 0x40000000
 
+/*
+ * The first eg_counter after the current one at which calc_envelope() may change anything.
+ * eg_out only moves on the counters selected by the rate mask, and a state transition is decided from eg_out
+ * alone, so between those counters the slot is left as it is. Running calc_envelope() earlier than necessary
+ * is always harmless.
+ */
+static INLINE uint32_t next_envelope_update(OPLL *opll, OPLL_SLOT *slot, uint32_t eg_counter) {
+  const uint16_t eg_out = opll->lanes.eg_out[slot->number];
+  const uint32_t mask = (1 << slot->eg_shift) - 1;
+  const uint32_t next = eg_counter + 1;
+  uint32_t step_mask;
+
+  switch (slot->eg_state) {
+  case DAMP:
+    if (eg_out >= EG_MUTE)
+      return next;
+    break;
+  case ATTACK:
+    if (eg_out == 0)
+      return next;
+    break;
+  case DECAY:
+    if ((eg_out >> 3) == slot->patch->SL)
+      return next;
+    break;
+  default:
+    break;
+  }
+
+  if (slot->eg_state == ATTACK) {
+    if (slot->eg_rate_h == 0 || slot->eg_rate_h == 15)
+      return eg_counter + EG_NEXT_NEVER;
+    step_mask = mask & ~3;
+  } else {
+    if (slot->eg_rate_h == 0 || eg_out >= EG_MUTE)
+      return eg_counter + EG_NEXT_NEVER;
+    step_mask = mask;
+  }
+
+  /* the next counter whose step_mask bits are all clear */
+  return (next & step_mask) == 0 ? next : (next | mask) + 1;
+}
+
+/*
+ * The phase of the slot itself is cleared before calc_phase() advances it, while the buddy slot has already been
+ * advanced in the same sample. Returns the slot bit of the buddy if its phase must be cleared after calc_phase().
+ */
+static INLINE uint32_t calc_envelope(OPLL *opll, OPLL_SLOT *slot, OPLL_SLOT *buddy, uint32_t eg_counter,
+                                     uint8_t test) {
+
+  uint16_t *eg_out = &opll->lanes.eg_out[slot->number];
   uint32_t mask = (1 << slot->eg_shift) - 1;
+  uint32_t buddy_reset = 0;
   uint8_t s;
 
   if (slot->eg_state == ATTACK) {
-    if (0 < slot->eg_out && 0 < slot->eg_rate_h && (eg_counter & mask & ~3) == 0) {
+    if (0 < *eg_out && 0 < slot->eg_rate_h && (eg_counter & mask & ~3) == 0) {
       s = lookup_attack_step(slot, eg_counter);
       if (0 < s) {
-        slot->eg_out = max(0, ((int)slot->eg_out - (slot->eg_out >> s) - 1));
+        *eg_out = max(0, ((int)*eg_out - (*eg_out >> s) - 1));
       }
     }
   } else {
     if (slot->eg_rate_h > 0 && (eg_counter & mask) == 0) {
-      slot->eg_out = min(EG_MUTE, slot->eg_out + lookup_decay_step(slot, eg_counter));
+      *eg_out = min(EG_MUTE, *eg_out + lookup_decay_step(slot, eg_counter));
     }
   }
 
   switch (slot->eg_state) {
   case DAMP:
-    if (slot->eg_out >= EG_MUTE) {
-      start_envelope(slot);
+    if (*eg_out >= EG_MUTE) {
+      start_envelope(slot, eg_out);
       if (slot->type & 1) {
         if (!slot->pg_keep) {
-          slot->pg_phase = 0;
+          opll->lanes.pg_phase[slot->number] = 0;
         }
         if (buddy && !buddy->pg_keep) {
-          buddy->pg_phase = 0;
+          buddy_reset = 1 << buddy->number;
         }
       }
     }
     break;
 
   case ATTACK:
-    if (slot->eg_out == 0) {
+    if (*eg_out == 0) {
       slot->eg_state = DECAY;
       request_update(slot, UPDATE_EG);
     }
     break;
 
   case DECAY:
-    if ((slot->eg_out >> 3) == slot->patch->SL) {
+    if ((*eg_out >> 3) == slot->patch->SL) {
       slot->eg_state = SUSTAIN;
       request_update(slot, UPDATE_EG);
     }
@@ -874,17 +994,63 @@ static INLINE void calc_envelope(OPLL_SLOT *slot, OPLL_SLOT *buddy, uint16_t eg_
   }
 
   if (test) {
-    slot->eg_out = 0;
+    *eg_out = 0;
+  }
+
+  slot->eg_next = next_envelope_update(opll, slot, eg_counter);
+
+  return buddy_reset;
+}
+
+/* channels whose slots are calculated in this sample */
+static INLINE uint32_t get_running_ch(OPLL *opll) {
+  if (!opll->auto_idle || opll->test_flag) {
+    return 0x1ff;
+  }
+  return opll->rhythm_mode ? (opll->active_ch | 0x1c0) : opll->active_ch;
+}
+
+/* a channel goes idle when its carrier can no longer make a sound until the next key-on */
+static INLINE void update_active_ch(OPLL *opll, int ch) {
+  const OPLL_SLOT *car = CAR(opll, ch);
+  if ((car->eg_state == RELEASE || car->eg_state == SUSTAIN) && opll->lanes.eg_out[car->number] >= EG_MUTE) {
+    opll->active_ch &= ~(1 << ch);
   }
 }
 
 static void update_slots(OPLL *opll) {
+  OPLL_SLOT_LANES *lanes = &opll->lanes;
+  uint32_t running = get_running_ch(opll);
+  const int32_t pm_step = (opll->pm_phase >> 10) & 7;
+  uint32_t buddy_reset = 0;
+  int num = opll->max_voices * 2;
   int i;
   opll->eg_counter++;
 
-  for (i = 0; i < opll->max_voices * 2; i++) {
+  /* the rhythm slots (ch 7-9) are always updated in rhythm mode, even if max_voices leaves them out */
+  if (opll->rhythm_mode && num < 18) {
+    running &= ((1 << opll->max_voices) - 1) | 0x1c0;
+    num = 18;
+  }
+
+  /* the phase kernel runs up to the last running channel */
+  while (num > 0 && !(running & (1 << ((num - 1) >> 1)))) {
+    num -= 2;
+  }
+
+  if (lanes->pm_step != pm_step) {
+    lanes->pm_step = pm_step;
+    for (i = 0; i < 18; i++) {
+      lanes->pg_inc[i] = calc_pg_inc(&opll->slot[i], pm_step);
+    }
+  }
+
+  for (i = 0; i < num; i++) {
     OPLL_SLOT *slot = &opll->slot[i];
     OPLL_SLOT *buddy = NULL;
+    if (!(running & (1 << (i >> 1)))) {
+      continue;
+    }
     if (slot->type == 0) {
       buddy = &opll->slot[i + 1];
     }
@@ -892,13 +1058,67 @@ static void update_slots(OPLL *opll) {
       buddy = &opll->slot[i - 1];
     }
     if (slot->update_requests) {
-      commit_slot_update(slot);
+      commit_slot_update(opll, slot);
+    } else if ((int32_t)(opll->eg_counter - slot->eg_next) < 0 && !opll->test_flag) {
+      /* nothing in the envelope can change until eg_next */
+      continue;
+    }
+    buddy_reset |= calc_envelope(opll, slot, buddy, opll->eg_counter, opll->test_flag & 1);
+    if (i & 1) {
+      update_active_ch(opll, i >> 1);
+    }
+  }
+
+  calc_phase(lanes, num, opll->test_flag & 4);
+
+  for (i = 0; buddy_reset; i++, buddy_reset >>= 1) {
+    if (buddy_reset & 1) {
+      lanes->pg_phase[i] = 0;
     }
-    calc_envelope(slot, buddy, opll->eg_counter, opll->test_flag & 1);
-    calc_phase(slot, opll->pm_phase, opll->test_flag & 4);
   }
 }
 
+/* attenuation of slot 0 to num - 1 for to_linear() */
+static INLINE void calc_attenuation(OPLL *opll, int num) {
+  OPLL_SLOT_LANES *lanes = &opll->lanes;
+  const uint16_t am = opll->lfo_am;
+  int i = 0;
+
+#if defined(OPLL_USE_NEON)
+  {
+    const uint16x8_t v_am = vdupq_n_u16(am);
+    const uint16x8_t v_max = vdupq_n_u16(EG_MAX);
+    for (; i < num; i += 8) {
+      uint16x8_t eg = vld1q_u16(lanes->eg_out + i);
+      uint16x8_t att = vaddq_u16(vaddq_u16(eg, vld1q_u16(lanes->tll + i)), vandq_u16(v_am, vld1q_u16(lanes->am_mask + i)));
+      att = vshlq_n_u16(vminq_u16(att, v_max), 4);
+      vst1q_u16(lanes->att + i, vorrq_u16(att, vcgeq_u16(eg, v_max)));
+    }
+  }
+#elif defined(OPLL_USE_SSE2)
+  {
+    const __m128i v_am = _mm_set1_epi16(am);
+    const __m128i v_max = _mm_set1_epi16(EG_MAX);
+    const __m128i v_mute = _mm_set1_epi16(EG_MAX - 1);
+    for (; i < num; i += 8) {
+      __m128i eg = _mm_loadu_si128((const __m128i *)(lanes->eg_out + i));
+      __m128i att = _mm_add_epi16(eg, _mm_loadu_si128((const __m128i *)(lanes->tll + i)));
+      att = _mm_add_epi16(att, _mm_and_si128(v_am, _mm_loadu_si128((const __m128i *)(lanes->am_mask + i))));
+      att = _mm_slli_epi16(_mm_min_epi16(att, v_max), 4);
+      _mm_storeu_si128((__m128i *)(lanes->att + i), _mm_or_si128(att, _mm_cmpgt_epi16(eg, v_mute)));
+    }
+  }
+#else
+  for (; i < num; i++) {
+    if (lanes->eg_out[i] >= EG_MAX) {
+      lanes->att[i] = 0xffff;
+    } else {
+      lanes->att[i] = min(EG_MAX, lanes->eg_out[i] + lanes->tll[i] + (am & lanes->am_mask[i])) << 4;
+    }
+  }
+#endif
+}
+
 /* output: -4095...4095 */
 static INLINE int16_t lookup_exp_table(uint16_t i) {
   /* from andete's expression */
@@ -907,34 +1127,34 @@ static INLINE int16_t lookup_exp_table(uint16_t i) {
   return ((i & 0x8000) ? ~res : res) << 1;
 }
 
-static INLINE int16_t to_linear(uint16_t h, OPLL_SLOT *slot, int16_t am) {
-  uint16_t att;
-  if (slot->eg_out >= EG_MAX)
+/* att: attenuation calculated by calc_attenuation() */
+static INLINE int16_t to_linear(uint16_t h, uint16_t att) {
+  if (att == 0xffff)
     return 0;
 
-  att = min(EG_MAX, (slot->eg_out + slot->tll + am)) << 4;
   return lookup_exp_table(h + att);
 }
 
 static INLINE int16_t calc_slot_car(OPLL *opll, int ch, int16_t fm) {
   OPLL_SLOT *slot = CAR(opll, ch);
-
-  uint8_t am = slot->patch->AM ? opll->lfo_am : 0;
+  const OPLL_SLOT_LANES *lanes = &opll->lanes;
 
   slot->output[1] = slot->output[0];
-  slot->output[0] = to_linear(slot->wave_table[(slot->pg_out + 2 * (fm >> 1)) & (PG_WIDTH - 1)], slot, am);
+  slot->output[0] = to_linear(slot->wave_table[(lanes->pg_out[slot->number] + 2 * (fm >> 1)) & (PG_WIDTH - 1)],
+                              lanes->att[slot->number]);
 
   return slot->output[0];
 }
 
 static INLINE int16_t calc_slot_mod(OPLL *opll, int ch) {
   OPLL_SLOT *slot = MOD(opll, ch);
+  const OPLL_SLOT_LANES *lanes = &opll->lanes;
 
   int16_t fm = slot->patch->FB > 0 ? (slot->output[1] + slot->output[0]) >> (9 - slot->patch->FB) : 0;
-  uint8_t am = slot->patch->AM ? opll->lfo_am : 0;
 
   slot->output[1] = slot->output[0];
-  slot->output[0] = to_linear(slot->wave_table[(slot->pg_out + fm) & (PG_WIDTH - 1)], slot, am);
+  slot->output[0] =
+      to_linear(slot->wave_table[(lanes->pg_out[slot->number] + fm) & (PG_WIDTH - 1)], lanes->att[slot->number]);
 
   return slot->output[0];
 }
@@ -942,112 +1162,118 @@ static INLINE int16_t calc_slot_mod(OPLL *opll, int ch) {
 static INLINE int16_t calc_slot_tom(OPLL *opll) {
   OPLL_SLOT *slot = MOD(opll, 8);
 
-  return to_linear(slot->wave_table[slot->pg_out], slot, 0);
+  return to_linear(slot->wave_table[opll->lanes.pg_out[slot->number]], opll->lanes.att[slot->number]);
 }
 
 /* Specify phase offset directly based on 10-bit (1024-length) sine table */
 #define _PD(phase) ((PG_BITS < 10) ? (phase >> (10 - PG_BITS)) : (phase << (PG_BITS - 10)))
 
+/*
+ * The snare, cymbal and hi-hat only pick one of a few fixed phases from the noise bits, so their phases are looked
+ * up from small tables indexed by those bits. A muted slot (att == 0xffff) skips the wave table.
+ */
+static const uint16_t snare_phase[4] = {_PD(0x100), _PD(0x0), _PD(0x200), _PD(0x300)};   /* [pg bit][noise] */
+static const uint16_t hat_phase[4] = {_PD(0xd0), _PD(0x34), _PD(0x234), _PD(0x2d0)};     /* [short][noise] */
+
 static INLINE int16_t calc_slot_snare(OPLL *opll) {
   OPLL_SLOT *slot = CAR(opll, 7);
+  const uint16_t att = opll->lanes.att[slot->number];
 
-  uint32_t phase;
-
-  if (BIT(slot->pg_out, PG_BITS - 2))
-    phase = (opll->noise & 1) ? _PD(0x300) : _PD(0x200);
-  else
-    phase = (opll->noise & 1) ? _PD(0x0) : _PD(0x100);
+  if (att == 0xffff)
+    return 0;
 
-  return to_linear(slot->wave_table[phase], slot, 0);
+  return lookup_exp_table(
+      slot->wave_table[snare_phase[(BIT(opll->lanes.pg_out[slot->number], PG_BITS - 2) << 1) | (opll->noise & 1)]] +
+      att);
 }
 
 static INLINE int16_t calc_slot_cym(OPLL *opll) {
   OPLL_SLOT *slot = CAR(opll, 8);
+  const uint16_t att = opll->lanes.att[slot->number];
 
-  uint32_t phase = opll->short_noise ? _PD(0x300) : _PD(0x100);
+  if (att == 0xffff)
+    return 0;
 
-  return to_linear(slot->wave_table[phase], slot, 0);
+  return lookup_exp_table(slot->wave_table[opll->short_noise ? _PD(0x300) : _PD(0x100)] + att);
 }
 
 static INLINE int16_t calc_slot_hat(OPLL *opll) {
   OPLL_SLOT *slot = MOD(opll, 7);
+  const uint16_t att = opll->lanes.att[slot->number];
 
-  uint32_t phase;
-
-  if (opll->short_noise)
-    phase = (opll->noise & 1) ? _PD(0x2d0) : _PD(0x234);
-  else
-    phase = (opll->noise & 1) ? _PD(0x34) : _PD(0xd0);
+  if (att == 0xffff)
+    return 0;
 
-  return to_linear(slot->wave_table[phase], slot, 0);
+  return lookup_exp_table(slot->wave_table[hat_phase[(opll->short_noise << 1) | (opll->noise & 1)]] + att);
 }
 
 #define _MO(x) (-(x) >> 1)
 #define _RO(x) (x)
 
+/* BD, HH, SD, TOM and CYM in rhythm mode. The noise generator runs even if the instruments are masked. */
+static INLINE void update_rhythm_output(OPLL *opll, uint32_t mask) {
+  int16_t *out = opll->ch_out;
+
+  /* CH7 */
+  if (!(mask & OPLL_MASK_BD)) {
+    out[9] = _RO(calc_slot_car(opll, 6, calc_slot_mod(opll, 6)));
+  }
+
+  update_noise(opll, 14);
+
+  /* CH8 */
+  if (!(mask & OPLL_MASK_HH)) {
+    out[10] = _RO(calc_slot_hat(opll));
+  }
+  if (!(mask & OPLL_MASK_SD)) {
+    out[11] = _RO(calc_slot_snare(opll));
+  }
+
+  /* CH9 (the tom and the cymbal do not use the noise, so its last 2 + 2 steps are taken together) */
+  if (!(mask & OPLL_MASK_TOM)) {
+    out[12] = _RO(calc_slot_tom(opll));
+  }
+  if (!(mask & OPLL_MASK_CYM)) {
+    out[13] = _RO(calc_slot_cym(opll));
+  }
+
+  update_noise(opll, 4);
+}
+
 static void update_output(OPLL *opll) {
   int16_t *out;
+  uint32_t running;
   int i;
 
+  PROFILE_MARK(opll);
   update_ampm(opll);
   if (opll->rhythm_mode) {
     update_short_noise(opll);
   }
+  PROFILE_LAP(opll, OPLL_PROFILE_AMPM);
   update_slots(opll);
+  calc_attenuation(opll, 18);
+  PROFILE_LAP(opll, OPLL_PROFILE_SLOTS);
 
   out = opll->ch_out;
+  /* taken once after update_slots, which is the only place in this sample where a channel can go idle */
+  running = get_running_ch(opll);
 
-  /* CH1-6 */
-  for (i = 0; i < 6; i++) {
+  /* CH1-6, CH7-9 in melody mode */
+  for (i = 0; i < (opll->rhythm_mode ? 6 : 9); i++) {
     if (!(opll->mask & OPLL_MASK_CH(i))) {
-      out[i] = _MO(calc_slot_car(opll, i, calc_slot_mod(opll, i)));
-    }
-  }
-
-  /* CH7 */
-  if (!opll->rhythm_mode) {
-    if (!(opll->mask & OPLL_MASK_CH(6))) {
-      out[6] = _MO(calc_slot_car(opll, 6, calc_slot_mod(opll, 6)));
-    }
-  } else {
-    if (!(opll->mask & OPLL_MASK_BD)) {
-      out[9] = _RO(calc_slot_car(opll, 6, calc_slot_mod(opll, 6)));
-    }
-
-    update_noise(opll, 14);
-  }
-
-  /* CH8 */
-  if (!opll->rhythm_mode) {
-    if (!(opll->mask & OPLL_MASK_CH(7))) {
-      out[7] = _MO(calc_slot_car(opll, 7, calc_slot_mod(opll, 7)));
-    }
-  } else {
-    if (!(opll->mask & OPLL_MASK_HH)) {
-      out[10] = _RO(calc_slot_hat(opll));
-    }
-    if (!(opll->mask & OPLL_MASK_SD)) {
-      out[11] = _RO(calc_slot_snare(opll));
+      if (running & (1 << i)) {
+        out[i] = _MO(calc_slot_car(opll, i, calc_slot_mod(opll, i)));
+      } else {
+        out[i] = 0;
+      }
     }
-
-    update_noise(opll, 2);
   }
 
-  /* CH9 */
-  if (!opll->rhythm_mode) {
-    if (!(opll->mask & OPLL_MASK_CH(8))) {
-      out[8] = _MO(calc_slot_car(opll, 8, calc_slot_mod(opll, 8)));
-    }
-  } else {
-    if (!(opll->mask & OPLL_MASK_TOM)) {
-      out[12] = _RO(calc_slot_tom(opll));
-    }
-    if (!(opll->mask & OPLL_MASK_CYM)) {
-      out[13] = _RO(calc_slot_cym(opll));
-    }
-
-    update_noise(opll, 2);
+  if (opll->rhythm_mode) {
+    update_rhythm_output(opll, opll->mask);
   }
+  PROFILE_LAP(opll, OPLL_PROFILE_CALC);
 }
 
 INLINE static void mix_output(OPLL *opll) {
@@ -1061,6 +1287,7 @@ INLINE static void mix_output(OPLL *opll) {
   } else {
     opll->mix_out[0] = out;
   }
+  PROFILE_LAP(opll, OPLL_PROFILE_MIX);
 }
 
 INLINE static void mix_output_stereo(OPLL *opll) {
@@ -1077,6 +1304,170 @@ INLINE static void mix_output_stereo(OPLL *opll) {
     OPLL_RateConv_putData(opll->conv, 0, out[0]);
     OPLL_RateConv_putData(opll->conv, 1, out[1]);
   }
+  PROFILE_LAP(opll, OPLL_PROFILE_MIX);
+}
+
+/***********************************************************
+
+                   Block Rendering
+
+***********************************************************/
+
+/*
+ * Mask, rhythm mode and pan settings can only change between calls, so the block renderers decide once per
+ * block which ch_out entries are recalculated. The entries that are not recalculated still hold their last
+ * value and are summed once into a constant offset, which keeps the result identical to mix_output().
+ */
+typedef struct {
+  int num_tone;
+  int tone[9];    /* melody channels to calculate */
+  int num_dyn;
+  int dyn[14];    /* ch_out entries updated by each sample */
+  int num_att;    /* number of slots whose attenuation is used */
+} OPLL_BlockPlan;
+
+static void plan_block(OPLL *opll, OPLL_BlockPlan *plan) {
+  const uint32_t mask = opll->mask;
+  const uint32_t running = get_running_ch(opll);
+  static const uint32_t rhythm_mask[5] = {OPLL_MASK_BD, OPLL_MASK_HH, OPLL_MASK_SD, OPLL_MASK_TOM, OPLL_MASK_CYM};
+  int i;
+
+  plan->num_tone = 0;
+  plan->num_dyn = 0;
+  plan->num_att = 0;
+
+  for (i = 0; i < (opll->rhythm_mode ? 6 : 9); i++) {
+    if (!(mask & OPLL_MASK_CH(i))) {
+      if (!(running & (1 << i))) {
+        /* idle channels are silent until the next key-on, which can not happen within a block */
+        opll->ch_out[i] = 0;
+        continue;
+      }
+      plan->tone[plan->num_tone++] = i;
+      plan->dyn[plan->num_dyn++] = i;
+      plan->num_att = i * 2 + 2;
+    }
+  }
+
+  if (opll->rhythm_mode) {
+    for (i = 0; i < 5; i++) {
+      if (!(mask & rhythm_mask[i])) {
+        plan->dyn[plan->num_dyn++] = 9 + i;
+        plan->num_att = 18;
+      }
+    }
+  }
+}
+
+static INLINE void update_output_planned(OPLL *opll, const OPLL_BlockPlan *plan) {
+  int16_t *out = opll->ch_out;
+  int i;
+
+  PROFILE_MARK(opll);
+  update_ampm(opll);
+  if (opll->rhythm_mode) {
+    update_short_noise(opll);
+  }
+  PROFILE_LAP(opll, OPLL_PROFILE_AMPM);
+  update_slots(opll);
+  calc_attenuation(opll, plan->num_att);
+  PROFILE_LAP(opll, OPLL_PROFILE_SLOTS);
+
+  for (i = 0; i < plan->num_tone; i++) {
+    const int ch = plan->tone[i];
+    out[ch] = _MO(calc_slot_car(opll, ch, calc_slot_mod(opll, ch)));
+  }
+
+  if (opll->rhythm_mode) {
+    update_rhythm_output(opll, opll->mask);
+  }
+  PROFILE_LAP(opll, OPLL_PROFILE_CALC);
+}
+
+/* render n samples at clk/72 Hz without rate conversion */
+static void render_block(OPLL *opll, int16_t *out, uint32_t n) {
+  OPLL_BlockPlan plan;
+  int32_t fixed = 0;
+  uint32_t i;
+  int k;
+
+  plan_block(opll, &plan);
+
+  for (k = 0; k < 14; k++) {
+    fixed += opll->ch_out[k];
+  }
+  for (k = 0; k < plan.num_dyn; k++) {
+    fixed -= opll->ch_out[plan.dyn[k]];
+  }
+
+  for (i = 0; i < n; i++) {
+    int32_t sum = fixed;
+    update_output_planned(opll, &plan);
+    for (k = 0; k < plan.num_dyn; k++) {
+      sum += opll->ch_out[plan.dyn[k]];
+    }
+    out[i] = (int16_t)sum;
+    PROFILE_LAP(opll, OPLL_PROFILE_MIX);
+  }
+
+  if (n > 0) {
+    opll->mix_out[0] = out[n - 1];
+  }
+}
+
+static void render_block_stereo(OPLL *opll, int16_t *out, uint32_t n) {
+  OPLL_BlockPlan plan;
+  int16_t fixed[2] = {0, 0};
+  int dyn_l[14], dyn_r[14];
+  float gain_l[14], gain_r[14];
+  int num_l = 0, num_r = 0;
+  uint8_t updated[14] = {0};
+  uint32_t i;
+  int k;
+
+  plan_block(opll, &plan);
+
+  for (k = 0; k < plan.num_dyn; k++) {
+    updated[plan.dyn[k]] = 1;
+  }
+
+  for (k = 0; k < 14; k++) {
+    if (opll->pan[k] & 2) {
+      if (updated[k]) {
+        dyn_l[num_l] = k;
+        gain_l[num_l++] = opll->pan_fine[k][0];
+      } else {
+        fixed[0] += (int16_t)(opll->ch_out[k] * opll->pan_fine[k][0]);
+      }
+    }
+    if (opll->pan[k] & 1) {
+      if (updated[k]) {
+        dyn_r[num_r] = k;
+        gain_r[num_r++] = opll->pan_fine[k][1];
+      } else {
+        fixed[1] += (int16_t)(opll->ch_out[k] * opll->pan_fine[k][1]);
+      }
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    int16_t l = fixed[0], r = fixed[1];
+    update_output_planned(opll, &plan);
+    for (k = 0; k < num_l; k++) {
+      l += (int16_t)(opll->ch_out[dyn_l[k]] * gain_l[k]);
+    }
+    for (k = 0; k < num_r; k++) {
+      r += (int16_t)(opll->ch_out[dyn_r[k]] * gain_r[k]);
+    }
+    out[i * 2 + 0] = l;
+    out[i * 2 + 1] = r;
+    PROFILE_LAP(opll, OPLL_PROFILE_MIX);
+  }
+
+  if (n > 0) {
+    opll->mix_out[0] = out[n * 2 - 2];
+    opll->mix_out[1] = out[n * 2 - 1];
+  }
 }
 
 /***********************************************************
@@ -1089,10 +1480,6 @@ OPLL *OPLL_new(uint32_t clk, uint32_t rate) {
   OPLL *opll;
   int i;
 
-  if (!table_initialized) {
-    initializeTables();
-  }
-
   opll = (OPLL *)calloc(sizeof(OPLL), 1);
   if (opll == NULL)
     return NULL;
@@ -1125,9 +1512,10 @@ static void reset_rate_conversion_params(OPLL *opll) {
   const double f_out = opll->rate;
   const double f_inp = opll->clk / 72.0;
 
+  /* the steps are scaled by 72 to keep them integer */
   opll->out_time = 0;
-  opll->out_step = f_inp;
-  opll->inp_step = f_out;
+  opll->out_step = opll->clk;
+  opll->inp_step = opll->rate * 72;
 
   if (opll->conv) {
     OPLL_RateConv_delete(opll->conv);
@@ -1135,7 +1523,7 @@ static void reset_rate_conversion_params(OPLL *opll) {
   }
 
   if (floor(f_inp) != f_out && floor(f_inp + 0.5) != f_out) {
-    opll->conv = OPLL_RateConv_new(f_inp, f_out, 2);
+    opll->conv = OPLL_RateConv_new(opll->out_step, opll->inp_step, 2);
   }
 
   if (opll->conv) {
@@ -1153,18 +1541,26 @@ void OPLL_reset(OPLL *opll) {
 
   opll->pm_phase = 0;
   opll->am_phase = 0;
+  opll->am_index = 0;
+  opll->lfo_am = am_table[0];
 
   opll->noise = 0x1;
   opll->mask = 0;
 
   opll->rhythm_mode = 0;
   opll->slot_key_status = 0;
+  opll->active_ch = 0;
   opll->eg_counter = 0;
 
   reset_rate_conversion_params(opll);
 
+  opll->lanes.pm_step = -1;
+  for (i = 0; i < OPLL_LANE_NUM; i++) {
+    opll->lanes.att[i] = 0xffff;
+  }
+
   for (i = 0; i < 18; i++)
-    reset_slot(&opll->slot[i], i);
+    reset_slot(opll, &opll->slot[i], i);
 
   for (i = 0; i < 9; i++) {
     set_patch(opll, i, 0);
@@ -1196,6 +1592,7 @@ void OPLL_forceRefresh(OPLL *opll) {
   for (i = 0; i < 18; i++) {
     request_update(&opll->slot[i], UPDATE_ALL);
   }
+  wake_envelopes(opll);
 }
 
 void OPLL_setRate(OPLL *opll, uint32_t rate) {
@@ -1207,16 +1604,17 @@ void OPLL_setQuality(OPLL *opll, uint8_t q) {}
 
 void OPLL_setChipType(OPLL *opll, uint8_t type) { opll->chip_type = type; }
 
-void OPLL_writeReg(OPLL *opll, uint32_t reg, uint8_t data) {
-  int ch, i;
-
-  if (reg >= 0x40)
-    return;
-
-  /* mirror registers */
+static INLINE uint32_t unmirror_reg(uint32_t reg) {
   if ((0x19 <= reg && reg <= 0x1f) || (0x29 <= reg && reg <= 0x2f) || (0x39 <= reg && reg <= 0x3f)) {
     reg -= 9;
   }
+  return reg;
+}
+
+/* Apply a register write except for the key on/off status.
+ * Returns 1 if update_key_status() must be called afterwards. */
+static int update_reg(OPLL *opll, uint32_t reg, uint8_t data) {
+  int ch, i;
 
   opll->reg[reg] = (uint8_t)data;
 
@@ -1229,6 +1627,7 @@ void OPLL_writeReg(OPLL *opll, uint32_t reg, uint8_t data) {
     opll->patch[0].ML = (data)&15;
     for (i = 0; i < 9; i++) {
       if (opll->patch_number[i] == 0) {
+        update_slot_lanes(opll, MOD(opll, i));
         request_update(MOD(opll, i), UPDATE_RKS | UPDATE_EG);
       }
     }
@@ -1242,6 +1641,7 @@ void OPLL_writeReg(OPLL *opll, uint32_t reg, uint8_t data) {
     opll->patch[1].ML = (data)&15;
     for (i = 0; i < 9; i++) {
       if (opll->patch_number[i] == 0) {
+        update_slot_lanes(opll, CAR(opll, i));
         request_update(CAR(opll, i), UPDATE_RKS | UPDATE_EG);
       }
     }
@@ -1314,8 +1714,7 @@ void OPLL_writeReg(OPLL *opll, uint32_t reg, uint8_t data) {
     if (opll->chip_type == 1)
       break;
     update_rhythm_mode(opll);
-    update_key_status(opll);
-    break;
+    return 1;
 
   case 0x0f:
     opll->test_flag = data;
@@ -1347,8 +1746,7 @@ void OPLL_writeReg(OPLL *opll, uint32_t reg, uint8_t data) {
     set_fnumber(opll, ch, ((data & 1) << 8) + opll->reg[0x10 + ch]);
     set_block(opll, ch, (data >> 1) & 7);
     set_sus_flag(opll, ch, (data >> 5) & 1);
-    update_key_status(opll);
-    break;
+    return 1;
 
   case 0x30:
   case 0x31:
@@ -1379,6 +1777,74 @@ void OPLL_writeReg(OPLL *opll, uint32_t reg, uint8_t data) {
   default:
     break;
   }
+
+  return 0;
+}
+
+void OPLL_writeReg(OPLL *opll, uint32_t reg, uint8_t data) {
+  if (reg >= 0x40)
+    return;
+
+  reg = unmirror_reg(reg);
+  if (update_reg(opll, reg, data))
+    update_key_status(opll);
+  wake_envelopes(opll);
+}
+
+void OPLL_writeRegs(OPLL *opll, const uint16_t *cmds, uint32_t n) {
+  uint64_t written = 0; /* registers already written in this batch */
+  uint32_t key_changed = 0; /* channels whose key bit changed since the last update_key_status() */
+  int key_pending = 0;
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    uint32_t reg = cmds[i] >> 8;
+    const uint8_t data = cmds[i] & 0xff;
+
+    if (reg >= 0x40)
+      continue;
+    reg = unmirror_reg(reg);
+
+    /* writing the same value again within a batch changes nothing */
+    if (BIT(written, reg) && opll->reg[reg] == data)
+      continue;
+
+    if (reg == 0x0e) {
+      /* a rhythm mode change alters the slot types that slotOff() looks at,
+         so the pending key changes are applied before r#14. */
+      if (key_pending) {
+        update_key_status(opll);
+        key_pending = 0;
+      }
+      key_changed = 0;
+      /* rhythm mode also changes the meaning of r#0x36-0x38 */
+      written = 0;
+    } else if (0x20 <= reg && reg <= 0x28) {
+      const uint32_t mask = 1 << (reg - 0x20);
+      if ((opll->reg[reg] ^ data) & 0x10) {
+        /* key off then key on (or the reverse) in one batch must still retrigger */
+        if (key_changed & mask) {
+          update_key_status(opll);
+          key_changed = 0;
+        }
+        key_changed |= mask;
+      }
+    }
+
+    written |= (uint64_t)1 << reg;
+
+    if (update_reg(opll, reg, data)) {
+      if (reg == 0x0e) {
+        update_key_status(opll);
+      } else {
+        key_pending = 1;
+      }
+    }
+  }
+
+  if (key_pending)
+    update_key_status(opll);
+  wake_envelopes(opll);
 }
 
 void OPLL_writeIO(OPLL *opll, uint32_t adr, uint8_t val) {
@@ -1436,6 +1902,7 @@ void OPLL_setPatch(OPLL *opll, const uint8_t *dump) {
     memcpy(&opll->patch[i * 2 + 0], &patch[0], sizeof(OPLL_PATCH));
     memcpy(&opll->patch[i * 2 + 1], &patch[1], sizeof(OPLL_PATCH));
   }
+  update_all_slot_lanes(opll);
 }
 
 void OPLL_patchToDump(const OPLL_PATCH *patch, uint8_t *dump) {
@@ -1451,12 +1918,14 @@ void OPLL_patchToDump(const OPLL_PATCH *patch, uint8_t *dump) {
 
 void OPLL_copyPatch(OPLL *opll, int32_t num, OPLL_PATCH *patch) {
   memcpy(&opll->patch[num], patch, sizeof(OPLL_PATCH));
+  update_all_slot_lanes(opll);
 }
 
 void OPLL_resetPatch(OPLL *opll, uint8_t type) {
   int i;
-  for (i = 0; i < 19 * 2; i++)
-    OPLL_copyPatch(opll, i, &default_patch[type % OPLL_TONE_NUM][i]);
+  for (i = 0; i < 19; i++)
+    OPLL_getDefaultPatch(type % OPLL_TONE_NUM, i, &opll->patch[i * 2]);
+  update_all_slot_lanes(opll);
 }
 
 int16_t OPLL_calc(OPLL *opll) {
@@ -1488,12 +1957,138 @@ void OPLL_calcStereo(OPLL *opll, int32_t out[2]) {
   }
 }
 
+/* number of input samples rendered at once while the rate converter is active */
+#define CONV_CHUNK 64
+
+/*
+ * Count how many output samples (up to n) can be made from at most CONV_CHUNK input samples,
+ * and how many input samples they need.
+ */
+static uint32_t plan_conv_chunk(OPLL *opll, uint32_t n, uint32_t *inp_num) {
+  uint32_t t = opll->out_time, k = 0, m = 0;
+
+  while (m < n) {
+    uint32_t need = 0;
+    while (opll->out_step > t) {
+      t += opll->inp_step;
+      need++;
+    }
+    if (k + need > CONV_CHUNK)
+      break;
+    t -= opll->out_step;
+    k += need;
+    m++;
+  }
+
+  *inp_num = k;
+  return m;
+}
+
+static void render_block_conv(OPLL *opll, int16_t *out, uint32_t n) {
+  int16_t inp[CONV_CHUNK];
+
+  while (n > 0) {
+    uint32_t inp_num, j = 0, i;
+    const uint32_t m = plan_conv_chunk(opll, n, &inp_num);
+
+    if (m == 0) {
+      /* too many input samples for one output sample */
+      *out++ = OPLL_calc(opll);
+      n--;
+      continue;
+    }
+
+    render_block(opll, inp, inp_num);
+    for (i = 0; i < m; i++) {
+      while (opll->out_step > opll->out_time) {
+        opll->out_time += opll->inp_step;
+        OPLL_RateConv_putData(opll->conv, 0, inp[j++]);
+      }
+      opll->out_time -= opll->out_step;
+      out[i] = OPLL_RateConv_getData(opll->conv, 0);
+    }
+    opll->mix_out[0] = out[m - 1];
+    out += m;
+    n -= m;
+  }
+}
+
+static void render_block_stereo_conv(OPLL *opll, int16_t *out, uint32_t n) {
+  int16_t inp[CONV_CHUNK * 2];
+
+  while (n > 0) {
+    uint32_t inp_num, j = 0, i;
+    const uint32_t m = plan_conv_chunk(opll, n, &inp_num);
+
+    if (m == 0) {
+      int32_t s[2];
+      OPLL_calcStereo(opll, s);
+      *out++ = (int16_t)s[0];
+      *out++ = (int16_t)s[1];
+      n--;
+      continue;
+    }
+
+    render_block_stereo(opll, inp, inp_num);
+    for (i = 0; i < m; i++) {
+      while (opll->out_step > opll->out_time) {
+        opll->out_time += opll->inp_step;
+        OPLL_RateConv_putData(opll->conv, 0, inp[j * 2 + 0]);
+        OPLL_RateConv_putData(opll->conv, 1, inp[j * 2 + 1]);
+        j++;
+      }
+      opll->out_time -= opll->out_step;
+      out[i * 2 + 0] = OPLL_RateConv_getData(opll->conv, 0);
+      out[i * 2 + 1] = OPLL_RateConv_getData(opll->conv, 1);
+    }
+    out += m * 2;
+    n -= m;
+  }
+}
+
 int16_t OPLL_calcNoRateConv(OPLL *opll) {
   update_output(opll);
   mix_output(opll);
   return opll->mix_out[0];
 }
 
+void OPLL_calcBlock(OPLL *opll, int16_t *out, uint32_t n) {
+  uint32_t i;
+
+  if (opll->conv == NULL && opll->out_step == opll->inp_step) {
+    render_block(opll, out, n);
+    return;
+  }
+  if (opll->conv) {
+    render_block_conv(opll, out, n);
+    return;
+  }
+
+  for (i = 0; i < n; i++) {
+    out[i] = OPLL_calc(opll);
+  }
+}
+
+void OPLL_calcBlockStereo(OPLL *opll, int16_t *out, uint32_t n) {
+  uint32_t i;
+
+  if (opll->conv == NULL && opll->out_step == opll->inp_step) {
+    render_block_stereo(opll, out, n);
+    return;
+  }
+  if (opll->conv) {
+    render_block_stereo_conv(opll, out, n);
+    return;
+  }
+
+  for (i = 0; i < n; i++) {
+    int32_t s[2];
+    OPLL_calcStereo(opll, s);
+    out[i * 2 + 0] = (int16_t)s[0];
+    out[i * 2 + 1] = (int16_t)s[1];
+  }
+}
+
 uint32_t OPLL_setMask(OPLL *opll, uint32_t mask) {
   uint32_t ret;
 
@@ -1519,4 +2114,24 @@ uint32_t OPLL_toggleMask(OPLL *opll, uint32_t mask) {
 void OPLL_setVoiceNum(OPLL *opll, int max_voices)
 {
   opll->max_voices = max_voices;
+  wake_envelopes(opll);
+}
+
+void OPLL_setAutoIdle(OPLL *opll, uint8_t enable) {
+  opll->auto_idle = enable;
+  wake_envelopes(opll);
 }
+
+uint32_t OPLL_getActiveMask(OPLL *opll) { return opll->active_ch; }
+
+#if OPLL_PROFILE
+void OPLL_setProfileCounter(uint32_t (*counter)(void)) { profile_counter = counter ? counter : profile_zero; }
+
+void OPLL_readProfile(OPLL *opll, uint32_t *counts) {
+  int i;
+  for (i = 0; i < OPLL_PROFILE_STAGE_NUM; i++) {
+    counts[i] = opll->profile[i];
+    opll->profile[i] = 0;
+  }
+}
+#endif
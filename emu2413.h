@@ -9,6 +9,14 @@ extern "C" {
 
 #define OPLL_DEBUG 0
 
+/*
+ * 1 to count the time spent in each stage of the sample calculation (see OPLL_readProfile).
+ * Changes the layout of OPLL, so define it for every file which includes this header.
+ */
+#ifndef OPLL_PROFILE
+#define OPLL_PROFILE 0
+#endif
+
 enum OPLL_TONE_ENUM { OPLL_2413_TONE = 0, OPLL_VRC7_TONE = 1, OPLL_281B_TONE = 2 };
 
 /* voice data */
@@ -27,15 +35,13 @@ typedef struct __OPLL_SLOT {
    */
   uint8_t type;
 
-  OPLL_PATCH *patch; /* voice parameter */
+  const OPLL_PATCH *patch; /* voice parameter */
 
   /* slot output */
   int32_t output[2]; /* output value, latest and previous. */
 
   /* phase generator (pg) */
-  uint16_t *wave_table; /* wave table */
-  uint32_t pg_phase;    /* pg phase */
-  uint32_t pg_out;      /* pg output, as index of wave table */
+  const uint16_t *wave_table; /* wave table */
   uint8_t pg_keep;      /* if 1, pg_phase is preserved when key-on */
   uint16_t blk_fnum;    /* (block << 9) | f-number */
   uint16_t fnum;        /* f-number (9 bits) */
@@ -46,12 +52,11 @@ typedef struct __OPLL_SLOT {
   int32_t volume;    /* current volume */
   uint8_t key_flag;  /* key-on flag 1:on 0:off */
   uint8_t sus_flag;  /* key-sus option 1:on 0:off */
-  uint16_t tll;      /* total level + key scale level*/
   uint8_t rks;       /* key scale offset (rks) for eg speed */
   uint8_t eg_rate_h; /* eg speed rate high 4bits */
   uint8_t eg_rate_l; /* eg speed rate low 2bits */
   uint32_t eg_shift; /* shift for eg global counter, controls envelope speed */
-  uint32_t eg_out;   /* eg output */
+  uint32_t eg_next;  /* eg_counter value from which calc_envelope() must run again */
 
   uint32_t update_requests; /* flags to debounce update */
 
@@ -60,6 +65,28 @@ typedef struct __OPLL_SLOT {
 #endif
 } OPLL_SLOT;
 
+/* number of lanes in OPLL_SLOT_LANES. 18 slots padded to a multiple of 8 x 16bit vectors. */
+#define OPLL_LANE_NUM 24
+
+/*
+ * per-sample slot state in structure-of-arrays layout, indexed by OPLL_SLOT.number.
+ * The phase and attenuation of all slots are calculated by vector kernels.
+ */
+typedef struct __OPLL_SLOT_LANES {
+  /* phase generator (pg) */
+  uint32_t pg_phase[OPLL_LANE_NUM]; /* pg phase */
+  uint32_t pg_inc[OPLL_LANE_NUM];   /* pg phase increment at pm_step */
+  uint32_t pg_out[OPLL_LANE_NUM];   /* pg output, as index of wave table */
+
+  /* envelope generator (eg) */
+  uint16_t eg_out[OPLL_LANE_NUM];  /* eg output */
+  uint16_t tll[OPLL_LANE_NUM];     /* total level + key scale level */
+  uint16_t am_mask[OPLL_LANE_NUM]; /* 0xffff if the slot is affected by am lfo */
+  uint16_t att[OPLL_LANE_NUM];     /* attenuation of wave table output, 0xffff if muted */
+
+  int32_t pm_step; /* pm lfo step which pg_inc is calculated for. -1 forces recalculation */
+} OPLL_SLOT_LANES;
+
 /* mask */
 #define OPLL_MASK_CH(x) (1 << (x))
 #define OPLL_MASK_HH (1 << (9))
@@ -69,16 +96,30 @@ typedef struct __OPLL_SLOT {
 #define OPLL_MASK_BD (1 << (13))
 #define OPLL_MASK_RHYTHM (OPLL_MASK_HH | OPLL_MASK_CYM | OPLL_MASK_TOM | OPLL_MASK_SD | OPLL_MASK_BD)
 
+/* stages counted when OPLL_PROFILE is 1 */
+enum OPLL_PROFILE_STAGE {
+  OPLL_PROFILE_AMPM = 0, /* lfo and noise (update_ampm) */
+  OPLL_PROFILE_SLOTS,    /* envelope and phase of the slots (update_slots) */
+  OPLL_PROFILE_CALC,     /* modulator and carrier output of the channels */
+  OPLL_PROFILE_MIX,      /* mixing the channel outputs */
+  OPLL_PROFILE_STAGE_NUM
+};
+
 /* rate conveter */
 typedef struct __OPLL_RateConv {
   int ch;
-  double timer;
-  double f_ratio;
-  int16_t *sinc_table;
-  int16_t **buf;
+  /* phase of the output between input samples (phase_q + phase_r / den) / 2^CONV_PHASE_BITS */
+  uint32_t phase_q;
+  uint32_t phase_r;
+  uint32_t step_q;
+  uint32_t step_r;
+  uint32_t den;
+  uint32_t pos;
+  int16_t *coef;
+  int16_t *buf;
 } OPLL_RateConv;
 
-OPLL_RateConv *OPLL_RateConv_new(double f_inp, double f_out, int ch);
+OPLL_RateConv *OPLL_RateConv_new(uint32_t f_inp, uint32_t f_out, int ch);
 void OPLL_RateConv_reset(OPLL_RateConv *conv);
 void OPLL_RateConv_putData(OPLL_RateConv *conv, int ch, int16_t data);
 int16_t OPLL_RateConv_getData(OPLL_RateConv *conv, int ch);
@@ -92,9 +133,10 @@ typedef struct __OPLL {
 
   uint32_t adr;
 
-  double inp_step;
-  double out_step;
-  double out_time;
+  /* in units of 1 / (clk * rate) sec */
+  uint32_t inp_step;
+  uint32_t out_step;
+  uint32_t out_time;
 
   uint8_t reg[0x40];
   uint8_t test_flag;
@@ -107,12 +149,14 @@ typedef struct __OPLL {
   int32_t am_phase;
 
   uint8_t lfo_am;
+  uint8_t am_index; /* (am_phase >> 6) % sizeof(am_table), kept without dividing */
 
   uint32_t noise;
   uint8_t short_noise;
 
   int32_t patch_number[9];
   OPLL_SLOT slot[18];
+  OPLL_SLOT_LANES lanes;
   OPLL_PATCH patch[19 * 2];
 
   uint8_t pan[16];
@@ -129,6 +173,16 @@ typedef struct __OPLL {
   OPLL_RateConv *conv;
 
   int max_voices;
+
+  /* melody channels which are keyed on or still sounding. bit 0..8: ch 1 to 9 */
+  uint32_t active_ch;
+  /* if 1, idle channels skip envelope, phase and output calculation */
+  uint8_t auto_idle;
+
+#if OPLL_PROFILE
+  uint32_t profile[OPLL_PROFILE_STAGE_NUM]; /* counts accumulated since the last OPLL_readProfile */
+  uint32_t profile_mark;                    /* counter value at the end of the last stage */
+#endif
 } OPLL;
 
 OPLL *OPLL_new(uint32_t clk, uint32_t rate);
@@ -181,6 +235,21 @@ void OPLL_setChipType(OPLL *opll, uint8_t type);
 void OPLL_writeIO(OPLL *opll, uint32_t reg, uint8_t val);
 void OPLL_writeReg(OPLL *opll, uint32_t reg, uint8_t val);
 
+/**
+ * Packed register write command for OPLL_writeRegs: (reg << 8) | val.
+ */
+#define OPLL_REG_CMD(reg, val) ((uint16_t)((((reg)&0xff) << 8) | ((val)&0xff)))
+
+/**
+ * Write a batch of registers. The result is the same as calling OPLL_writeReg
+ * for each command in order, but writes of an unchanged value within the batch
+ * are skipped and the key on/off status is updated once per batch
+ * (plus once per key off/on pair on the same channel, to keep the retrigger).
+ * @param cmds array of OPLL_REG_CMD(reg, val)
+ * @param n number of commands
+ */
+void OPLL_writeRegs(OPLL *opll, const uint16_t *cmds, uint32_t n);
+
 /**
  * Calculate one sample
  */
@@ -196,6 +265,20 @@ void OPLL_calcStereo(OPLL *opll, int32_t out[2]);
  */
 int16_t OPLL_calcNoRateConv(OPLL *opll);
 
+/**
+ * Calculate a block of samples. Equivalent to calling OPLL_calc n times.
+ * @param out buffer for n samples
+ * @param n number of samples
+ */
+void OPLL_calcBlock(OPLL *opll, int16_t *out, uint32_t n);
+
+/**
+ * Calculate a block of stereo samples. Equivalent to calling OPLL_calcStereo n times.
+ * @param out buffer for n interleaved L/R sample pairs (n * 2 elements)
+ * @param n number of sample pairs
+ */
+void OPLL_calcBlockStereo(OPLL *opll, int16_t *out, uint32_t n);
+
 void OPLL_setPatch(OPLL *, const uint8_t *dump);
 void OPLL_copyPatch(OPLL *, int32_t, OPLL_PATCH *);
 
@@ -231,6 +314,38 @@ uint32_t OPLL_toggleMask(OPLL *, uint32_t mask);
  */
 void OPLL_setVoiceNum(OPLL *, int max_voices);
 
+/**
+ * Enable or disable skipping of idle channels.
+ * A melody channel becomes idle when its carrier reaches the muted level in the release (or sustain) state, and
+ * stays idle until its next key-on. Idle channels cost almost nothing. Because the modulator of an idle channel is
+ * frozen as well, the first samples after key-on may differ slightly from the continuous emulation. A channel which
+ * becomes audible again without a key-on (ch 7-9 when rhythm mode is turned on, or any channel while the test
+ * register is set) starts from its frozen envelope and phase, and may differ more. tools/golden checks the
+ * difference (paths idle9 / idle6).
+ * @param enable 0:off (default) 1:on
+ */
+void OPLL_setAutoIdle(OPLL *, uint8_t enable);
+
+/**
+ * Get the melody channels which are keyed on or still sounding
+ * @return bit 0..8: ch 1 to 9 (OPLL_MASK_CH(i))
+ */
+uint32_t OPLL_getActiveMask(OPLL *);
+
+#if OPLL_PROFILE
+/**
+ * Set the function which reads a free-running counter (e.g. a cycle counter) for the profile.
+ * The counter is shared by all OPLL instances. Until it is set, nothing is counted.
+ */
+void OPLL_setProfileCounter(uint32_t (*counter)(void));
+
+/**
+ * Copy the counts accumulated in each stage since the last call to counts, and clear them.
+ * @param counts array of OPLL_PROFILE_STAGE_NUM elements, indexed by OPLL_PROFILE_STAGE
+ */
+void OPLL_readProfile(OPLL *, uint32_t *counts);
+#endif
+
 /* for compatibility */
 #define OPLL_set_rate OPLL_setRate
 #define OPLL_set_quality OPLL_setQuality
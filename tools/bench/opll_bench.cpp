@@ -0,0 +1,394 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+// emu2413 throughput benchmark (host build)
+//
+// usage: opll_bench [-f csv|json] [-n samples] [-s sweep]
+//   -f  output format (default: csv)
+//   -n  number of output samples rendered per case (default: 480000)
+//   -s  sweep to run: all, api, voices, patch, rhythm, idle, chips (default: all)
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "emu2413.h"
+}
+
+namespace {
+
+enum Api {
+    kApiCalc,
+    kApiCalcStereo,
+    kApiCalcNoRateConv,
+    kApiCalcBlock,
+    kApiCalcBlockStereo,
+    kApiNum
+};
+
+const char *kApiName[kApiNum] = {
+    "OPLL_calc",
+    "OPLL_calcStereo",
+    "OPLL_calcNoRateConv",
+    "OPLL_calcBlock",
+    "OPLL_calcBlockStereo",
+};
+
+struct RateSetting {
+    const char *name;
+    uint32_t clk;
+    uint32_t rate;
+};
+
+// "spresense" is what FMTGSink uses (clk / 72 == rate, converter disabled)
+const RateSetting kRates[] = {
+    { "spresense", 3456000, 48000 },
+    { "native",    3579545, 49716 },
+    { "48k",       3579545, 48000 },
+    { "44k",       3579545, 44100 },
+};
+const int kRateNum = sizeof(kRates) / sizeof(kRates[0]);
+
+struct Case {
+    Api api;
+    int rate;      // index of kRates
+    int voices;    // OPLL_setVoiceNum
+    int patch;     // ROM patch number (1-15)
+    bool rhythm;
+    int keyOn;     // number of channels keyed on, -1: same as voices
+    bool autoIdle; // OPLL_setAutoIdle
+    int chips;     // number of OPLL instances mixed together (as FMTGSink does)
+};
+
+Case makeCase(Api api, int rate, int voices, int patch, bool rhythm) {
+    Case c;
+    c.api = api;
+    c.rate = rate;
+    c.voices = voices;
+    c.patch = patch;
+    c.rhythm = rhythm;
+    c.keyOn = -1;
+    c.autoIdle = false;
+    c.chips = 1;
+    return c;
+}
+
+struct Result {
+    Case c;
+    uint32_t samples;
+    double ns_per_sample;
+    double samples_per_sec;
+};
+
+const int kBlockSize = 240;        // same as FMTGSink
+const int kRetriggerBlocks = 100;  // key on again every 0.5 sec
+
+// F-Numbers of C4 - C5 at block 4
+const uint16_t kFnum[9] = { 172, 193, 217, 230, 258, 290, 325, 345, 387 };
+
+int keyOnCount(const Case &c) {
+    return (c.keyOn < 0) ? c.voices : c.keyOn;
+}
+
+void keyOn(OPLL *opll, const Case &c) {
+    const int melody_ch = c.rhythm ? 6 : 9;
+
+    for (int ch = 0; ch < melody_ch; ch++) {
+        OPLL_writeReg(opll, 0x20 + ch, 0x00);
+    }
+    for (int ch = 0; ch < keyOnCount(c) && ch < melody_ch; ch++) {
+        OPLL_writeReg(opll, 0x30 + ch, (c.patch << 4) | 0x00);
+        OPLL_writeReg(opll, 0x10 + ch, kFnum[ch] & 0xff);
+        OPLL_writeReg(opll, 0x20 + ch, 0x10 | (4 << 1) | (kFnum[ch] >> 8));
+    }
+
+    if (c.rhythm) {
+        OPLL_writeReg(opll, 0x0e, 0x20);
+        OPLL_writeReg(opll, 0x0e, 0x3f);
+    }
+}
+
+void setup(OPLL *opll, const Case &c) {
+    OPLL_setVoiceNum(opll, c.rhythm ? 9 : c.voices);
+    OPLL_setAutoIdle(opll, c.autoIdle ? 1 : 0);
+
+    uint32_t mask = 0;
+    for (int ch = c.voices; ch < 9; ch++) {
+        mask |= OPLL_MASK_CH(ch);
+    }
+    if (c.rhythm) {
+        // ch 7-9 are used for the rhythm instruments
+        mask &= ~(OPLL_MASK_CH(6) | OPLL_MASK_CH(7) | OPLL_MASK_CH(8));
+        OPLL_writeReg(opll, 0x16, 0x20);
+        OPLL_writeReg(opll, 0x17, 0x50);
+        OPLL_writeReg(opll, 0x18, 0xc0);
+        OPLL_writeReg(opll, 0x26, 0x05);
+        OPLL_writeReg(opll, 0x27, 0x05);
+        OPLL_writeReg(opll, 0x28, 0x01);
+        OPLL_writeReg(opll, 0x36, 0x00);
+        OPLL_writeReg(opll, 0x37, 0x00);
+        OPLL_writeReg(opll, 0x38, 0x00);
+    }
+    OPLL_setMask(opll, mask);
+}
+
+// mixes the block outputs of several chips with int32 accumulation, same as FMTGSink::renderBlock
+int32_t renderChips(const std::vector<OPLL *> &opll, uint32_t n) {
+    int16_t buf[kBlockSize];
+    int32_t mix[kBlockSize] = {};
+    int shift = 0;
+
+    while ((9 << shift) < (int)opll.size() * 3) {
+        shift++;
+    }
+    for (OPLL *o : opll) {
+        OPLL_calcBlock(o, buf, n);
+        for (uint32_t i = 0; i < n; i++) {
+            mix[i] += buf[i];
+        }
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        int32_t v = mix[i] >> shift;
+        buf[i] = (v > 32767) ? 32767 : ((v < -32768) ? -32768 : v);
+    }
+
+    return buf[n - 1];
+}
+
+// returns a checksum so that the compiler cannot drop the rendering
+int32_t render(const std::vector<OPLL *> &chips, const Case &c, uint32_t samples) {
+    OPLL *opll = chips[0];
+    int16_t buf[kBlockSize * 2];
+    int32_t sum = 0;
+    uint32_t done = 0;
+    int blocks = 0;
+
+    while (done < samples) {
+        if (blocks % kRetriggerBlocks == 0) {
+            for (OPLL *o : chips) {
+                keyOn(o, c);
+            }
+        }
+
+        uint32_t n = samples - done;
+        if (n > kBlockSize) {
+            n = kBlockSize;
+        }
+
+        if (chips.size() > 1) {
+            sum += renderChips(chips, n);
+            done += n;
+            blocks++;
+            continue;
+        }
+
+        switch (c.api) {
+        case kApiCalc:
+            for (uint32_t i = 0; i < n; i++) {
+                sum += OPLL_calc(opll);
+            }
+            break;
+        case kApiCalcStereo:
+            for (uint32_t i = 0; i < n; i++) {
+                int32_t out[2];
+                OPLL_calcStereo(opll, out);
+                sum += out[0] + out[1];
+            }
+            break;
+        case kApiCalcNoRateConv:
+            for (uint32_t i = 0; i < n; i++) {
+                sum += OPLL_calcNoRateConv(opll);
+            }
+            break;
+        case kApiCalcBlock:
+            OPLL_calcBlock(opll, buf, n);
+            sum += buf[n - 1];
+            break;
+        case kApiCalcBlockStereo:
+            OPLL_calcBlockStereo(opll, buf, n);
+            sum += buf[n * 2 - 2] + buf[n * 2 - 1];
+            break;
+        default:
+            break;
+        }
+
+        done += n;
+        blocks++;
+    }
+
+    return sum;
+}
+
+Result run(const Case &c, uint32_t samples) {
+    const RateSetting &r = kRates[c.rate];
+    std::vector<OPLL *> chips;
+
+    for (int i = 0; i < c.chips; i++) {
+        OPLL *opll = OPLL_new(r.clk, r.rate);
+        setup(opll, c);
+        chips.push_back(opll);
+    }
+    render(chips, c, samples / 10);  // warm up
+
+    auto start = std::chrono::steady_clock::now();
+    volatile int32_t sink = render(chips, c, samples);
+    auto end = std::chrono::steady_clock::now();
+    (void)sink;
+
+    for (OPLL *opll : chips) {
+        OPLL_delete(opll);
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+    Result res;
+    res.c = c;
+    res.samples = samples;
+    res.ns_per_sample = ns / samples;
+    res.samples_per_sec = samples * 1e9 / ns;
+    return res;
+}
+
+std::vector<Case> makeCases(const std::string &sweep) {
+    std::vector<Case> cases;
+    const bool all = (sweep == "all");
+
+    if (all || sweep == "api") {
+        // every API at every rate converter setting
+        for (int r = 0; r < kRateNum; r++) {
+            for (int a = 0; a < kApiNum; a++) {
+                cases.push_back(makeCase((Api)a, r, 9, 1, false));
+            }
+        }
+    }
+
+    if (all || sweep == "voices") {
+        // per-voice cost of the path used by FMTGSink
+        for (int a : { kApiCalcNoRateConv, kApiCalcBlock }) {
+            for (int v = 1; v <= 9; v++) {
+                cases.push_back(makeCase((Api)a, 0, v, 1, false));
+            }
+        }
+    }
+
+    if (all || sweep == "patch") {
+        for (int p = 1; p <= 15; p++) {
+            cases.push_back(makeCase(kApiCalcBlock, 0, 9, p, false));
+        }
+    }
+
+    if (all || sweep == "rhythm") {
+        for (int a = 0; a < kApiNum; a++) {
+            cases.push_back(makeCase((Api)a, 0, 6, 1, false));
+            cases.push_back(makeCase((Api)a, 0, 6, 1, true));
+        }
+    }
+
+    if (all || sweep == "idle") {
+        // 9 voices enabled, only some of them keyed on
+        for (int idle : { 0, 1 }) {
+            for (int k = 0; k <= 9; k += 3) {
+                Case c = makeCase(kApiCalcBlock, 0, 9, 1, false);
+                c.keyOn = k;
+                c.autoIdle = (idle != 0);
+                cases.push_back(c);
+            }
+        }
+    }
+
+    if (all || sweep == "chips") {
+        // FMTGSink with several chips of FMTGSINK_MAX_VOICES (3) voices
+        for (int n = 1; n <= 8; n++) {
+            Case c = makeCase(kApiCalcBlock, 0, 3, 1, false);
+            c.autoIdle = true;
+            c.chips = n;
+            cases.push_back(c);
+        }
+    }
+
+    return cases;
+}
+
+void printCsv(const std::vector<Result> &results) {
+    printf("api,rate,clk,sample_rate,chips,voices,key_on,auto_idle,patch,mode,samples,ns_per_sample,samples_per_sec\n");
+    for (const Result &res : results) {
+        const RateSetting &r = kRates[res.c.rate];
+        printf("%s,%s,%u,%u,%d,%d,%d,%d,%d,%s,%u,%.2f,%.0f\n",
+               kApiName[res.c.api], r.name, r.clk, r.rate, res.c.chips, res.c.voices, keyOnCount(res.c),
+               res.c.autoIdle ? 1 : 0,
+               res.c.patch, res.c.rhythm ? "rhythm" : "melody", res.samples, res.ns_per_sample, res.samples_per_sec);
+    }
+}
+
+void printJson(const std::vector<Result> &results) {
+    printf("[\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &res = results[i];
+        const RateSetting &r = kRates[res.c.rate];
+        printf("  {\"api\": \"%s\", \"rate\": \"%s\", \"clk\": %u, \"sample_rate\": %u, \"chips\": %d, "
+               "\"voices\": %d, \"key_on\": %d, \"auto_idle\": %d, \"patch\": %d, \"mode\": \"%s\", \"samples\": %u, "
+               "\"ns_per_sample\": %.2f, \"samples_per_sec\": %.0f}%s\n",
+               kApiName[res.c.api], r.name, r.clk, r.rate, res.c.chips, res.c.voices, keyOnCount(res.c),
+               res.c.autoIdle ? 1 : 0, res.c.patch, res.c.rhythm ? "rhythm" : "melody", res.samples, res.ns_per_sample, res.samples_per_sec,
+               (i + 1 < results.size()) ? "," : "");
+    }
+    printf("]\n");
+}
+
+void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-f csv|json] [-n samples] [-s all|api|voices|patch|rhythm|idle|chips]\n", name);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    std::string format = "csv";
+    std::string sweep = "all";
+    uint32_t samples = 480000;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            format = argv[++i];
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            samples = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            sweep = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((format != "csv" && format != "json") || samples == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<Case> cases = makeCases(sweep);
+    if (cases.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<Result> results;
+    for (const Case &c : cases) {
+        results.push_back(run(c, samples));
+    }
+
+    if (format == "json") {
+        printJson(results);
+    } else {
+        printCsv(results);
+    }
+
+    return 0;
+}
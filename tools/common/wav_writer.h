@@ -0,0 +1,83 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+// Minimal 16-bit mono WAV writer shared by the host tools
+
+#ifndef TOOLS_COMMON_WAV_WRITER_H_
+#define TOOLS_COMMON_WAV_WRITER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+class WavWriter {
+public:
+    WavWriter() : fp_(nullptr), rate_(0), sample_num_(0) {
+    }
+
+    ~WavWriter() {
+        close();
+    }
+
+    bool open(const char *path, uint32_t rate) {
+        fp_ = fopen(path, "wb");
+        if (fp_ == nullptr) {
+            return false;
+        }
+        rate_ = rate;
+        sample_num_ = 0;
+        writeHeader();  // the sizes are patched by close()
+        return true;
+    }
+
+    void write(const int16_t *samples, uint32_t n) {
+        if (fp_) {
+            fwrite(samples, sizeof(samples[0]), n, fp_);
+            sample_num_ += n;
+        }
+    }
+
+    void close() {
+        if (fp_) {
+            fseek(fp_, 0, SEEK_SET);
+            writeHeader();
+            fclose(fp_);
+            fp_ = nullptr;
+        }
+    }
+
+private:
+    FILE *fp_;
+    uint32_t rate_;
+    uint32_t sample_num_;
+
+    void putLE16(uint16_t v) {
+        fputc(v & 0xff, fp_);
+        fputc(v >> 8, fp_);
+    }
+
+    void putLE32(uint32_t v) {
+        putLE16(v & 0xffff);
+        putLE16(v >> 16);
+    }
+
+    void writeHeader() {
+        const uint32_t data_size = sample_num_ * 2;
+        fwrite("RIFF", 1, 4, fp_);
+        putLE32(36 + data_size);
+        fwrite("WAVEfmt ", 1, 8, fp_);
+        putLE32(16);
+        putLE16(1);          // PCM
+        putLE16(1);          // mono
+        putLE32(rate_);
+        putLE32(rate_ * 2);  // bytes per second
+        putLE16(2);          // block align
+        putLE16(16);         // bits per sample
+        fwrite("data", 1, 4, fp_);
+        putLE32(data_size);
+    }
+};
+
+#endif  // TOOLS_COMMON_WAV_WRITER_H_
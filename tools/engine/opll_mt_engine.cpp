@@ -0,0 +1,335 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+// Multithreaded emu2413 render engine (host build)
+//
+// Every OPLL instance (chip) is owned by one worker thread. The control thread sends register writes to each
+// chip through a lock-free SPSC queue; they are applied at the next block boundary. Workers render a block of
+// all their chips, and the control thread mixes the chips once every worker has finished the block. While it
+// mixes block k, the workers already render block k + 1.
+//
+// This mirrors the plan to distribute chips across the Spresense sub-cores, and reports how the throughput
+// scales from 1 to N threads. The mixed output must be identical for every thread count.
+//
+// usage: opll_mt_engine [-f csv|json] [-c chips] [-v voices] [-t max_threads] [-s seconds]
+//   -f  output format (default: csv)
+//   -c  number of chips (default: 8)
+//   -v  voices per chip (default: 9)
+//   -t  maximum number of worker threads (default: number of hardware threads)
+//   -s  length of the rendered audio in seconds (default: 10)
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SpscRing.h"
+
+extern "C" {
+#include "emu2413.h"
+}
+
+namespace {
+
+const uint32_t kClk = 3456000;  // same as FMTGSink
+const uint32_t kRate = 48000;
+const int kBlockSize = 240;
+const size_t kQueueSize = 1024;
+
+// F-Numbers of C4 - B4
+const uint16_t kFnum[12] = { 172, 183, 193, 205, 217, 230, 244, 258, 274, 290, 307, 325 };
+
+struct RegWrite {
+    uint32_t block;  // applied before rendering this block
+    uint16_t cmd;    // OPLL_REG_CMD(reg, data)
+};
+
+struct Chip {
+    OPLL *opll;
+    SpscRing<RegWrite, kQueueSize> queue;
+    uint16_t cmds[kQueueSize];  // writes for the current block, applied with OPLL_writeRegs
+    int16_t out[2][kBlockSize];  // double buffered by block number
+};
+
+class MtEngine {
+public:
+    MtEngine(int chip_num, int voice_num, int thread_num)
+        : chips_(chip_num), voice_num_(voice_num), thread_num_(thread_num), go_(0), quit_(false), done_(thread_num) {
+        uint32_t mask = 0;
+        for (int ch = voice_num; ch < 9; ch++) {
+            mask |= OPLL_MASK_CH(ch);
+        }
+        for (Chip *&chip : chips_) {
+            chip = new Chip;
+            chip->opll = OPLL_new(kClk, kRate);
+            OPLL_setVoiceNum(chip->opll, voice_num);
+            OPLL_setAutoIdle(chip->opll, 1);
+            OPLL_setMask(chip->opll, mask);
+        }
+
+        // same headroom as FMTGSink::renderBlock
+        mix_shift_ = 0;
+        while ((9 << mix_shift_) < chip_num * voice_num) {
+            mix_shift_++;
+        }
+
+        for (int w = 0; w < thread_num_; w++) {
+            done_[w].store(0);
+            workers_.push_back(std::thread(&MtEngine::workerMain, this, w));
+        }
+    }
+
+    ~MtEngine() {
+        quit_.store(true, std::memory_order_release);
+        for (std::thread &t : workers_) {
+            t.join();
+        }
+        for (Chip *chip : chips_) {
+            OPLL_delete(chip->opll);
+            delete chip;
+        }
+    }
+
+    int getChipNum() const {
+        return (int)chips_.size();
+    }
+
+    // called by the control thread before startBlock(block)
+    void writeReg(int chip, uint32_t block, uint8_t reg, uint8_t data) {
+        RegWrite w = { block, OPLL_REG_CMD(reg, data) };
+        while (!chips_[chip]->queue.push(w)) {
+            // the worker drains the queue at its next block
+            std::this_thread::yield();
+        }
+    }
+
+    // lets the workers render the block
+    void startBlock(uint32_t block) {
+        go_.store(block + 1, std::memory_order_release);
+    }
+
+    // waits for the block and mixes it
+    void mixBlock(uint32_t block, int16_t *out) {
+        for (int w = 0; w < thread_num_; w++) {
+            while (done_[w].load(std::memory_order_acquire) <= block) {
+                std::this_thread::yield();
+            }
+        }
+
+        int32_t mix[kBlockSize] = {};
+        for (Chip *chip : chips_) {
+            const int16_t *in = chip->out[block & 1];
+            for (int i = 0; i < kBlockSize; i++) {
+                mix[i] += in[i];
+            }
+        }
+        for (int i = 0; i < kBlockSize; i++) {
+            int32_t v = mix[i] >> mix_shift_;
+            out[i] = (v > 32767) ? 32767 : ((v < -32768) ? -32768 : v);
+        }
+    }
+
+private:
+    std::vector<Chip *> chips_;
+    int voice_num_;
+    int thread_num_;
+    int mix_shift_;
+    std::vector<std::thread> workers_;
+    std::atomic<uint32_t> go_;
+    std::atomic<bool> quit_;
+    std::vector<std::atomic<uint32_t>> done_;
+
+    // chip c belongs to worker c % thread_num_
+    void workerMain(int worker) {
+        uint32_t block = 0;
+
+        for (;;) {
+            while (go_.load(std::memory_order_acquire) <= block) {
+                if (quit_.load(std::memory_order_acquire)) {
+                    return;
+                }
+                std::this_thread::yield();
+            }
+
+            for (size_t c = worker; c < chips_.size(); c += thread_num_) {
+                Chip *chip = chips_[c];
+                const RegWrite *w;
+                uint32_t cmd_num = 0;
+                while ((w = chip->queue.peek()) != nullptr && w->block <= block) {
+                    chip->cmds[cmd_num++] = w->cmd;
+                    RegWrite dummy;
+                    chip->queue.pop(&dummy);
+                }
+                OPLL_writeRegs(chip->opll, chip->cmds, cmd_num);
+                OPLL_calcBlock(chip->opll, chip->out[block & 1], kBlockSize);
+            }
+
+            block++;
+            done_[worker].store(block, std::memory_order_release);
+        }
+    }
+};
+
+// deterministic note on/off pattern, independent of the thread count
+class Sequencer {
+public:
+    Sequencer(int chip_num, int voice_num) : rng_(1), voice_num_(voice_num), notes_(chip_num * voice_num, -1) {
+    }
+
+    void generate(MtEngine &engine, uint32_t block) {
+        for (size_t v = 0; v < notes_.size(); v++) {
+            const int chip = (int)v % engine.getChipNum();
+            const int ch = (int)v / engine.getChipNum();
+
+            // every voice changes its state about every 100 ms
+            if (next() % 20 != 0) {
+                continue;
+            }
+            if (notes_[v] < 0) {
+                const int note = next() % 12;
+                notes_[v] = note;
+                engine.writeReg(chip, block, 0x30 + ch, (uint8_t)(((next() % 15 + 1) << 4) | (next() % 4)));
+                engine.writeReg(chip, block, 0x10 + ch, kFnum[note] & 0xff);
+                engine.writeReg(chip, block, 0x20 + ch, 0x10 | (4 << 1) | (kFnum[note] >> 8));
+            } else {
+                engine.writeReg(chip, block, 0x20 + ch, (4 << 1) | (kFnum[notes_[v]] >> 8));
+                notes_[v] = -1;
+            }
+        }
+    }
+
+private:
+    uint32_t rng_;
+    int voice_num_;
+    std::vector<int> notes_;
+
+    uint32_t next() {
+        rng_ = rng_ * 1664525u + 1013904223u;
+        return rng_ >> 8;
+    }
+};
+
+struct Result {
+    int threads;
+    double seconds;
+    double samples_per_sec;
+    uint32_t checksum;
+};
+
+Result run(int chip_num, int voice_num, int thread_num, uint32_t block_num) {
+    MtEngine engine(chip_num, voice_num, thread_num);
+    Sequencer seq(chip_num, voice_num);
+    int16_t out[kBlockSize];
+    uint32_t hash = 2166136261u;  // FNV-1a of the mixed output
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t block = 0; block <= block_num; block++) {
+        if (block < block_num) {
+            seq.generate(engine, block);
+            engine.startBlock(block);
+        }
+        if (block > 0) {
+            engine.mixBlock(block - 1, out);
+            for (int i = 0; i < kBlockSize; i++) {
+                hash = (hash ^ (uint16_t)out[i]) * 16777619u;
+            }
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    Result res;
+    res.threads = thread_num;
+    res.seconds = std::chrono::duration<double>(end - start).count();
+    res.samples_per_sec = (double)block_num * kBlockSize / res.seconds;
+    res.checksum = hash;
+    return res;
+}
+
+void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-f csv|json] [-c chips] [-v voices] [-t max_threads] [-s seconds]\n", name);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    std::string format = "csv";
+    int chip_num = 8;
+    int voice_num = 9;
+    int max_threads = (int)std::thread::hardware_concurrency();
+    double seconds = 10;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            format = argv[++i];
+        } else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            chip_num = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-v") && i + 1 < argc) {
+            voice_num = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            max_threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((format != "csv" && format != "json") || chip_num < 1 || voice_num < 1 || voice_num > 9 || seconds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (max_threads < 1) {
+        max_threads = 1;
+    }
+    if (max_threads > chip_num) {
+        max_threads = chip_num;
+    }
+
+    const uint32_t block_num = (uint32_t)(seconds * kRate / kBlockSize);
+    std::vector<Result> results;
+    for (int t = 1; t <= max_threads; t++) {
+        results.push_back(run(chip_num, voice_num, t, block_num));
+    }
+
+    int status = 0;
+    if (format == "json") {
+        printf("[\n");
+    } else {
+        printf("threads,chips,voices,samples,seconds,samples_per_sec,realtime_ratio,speedup,checksum\n");
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &res = results[i];
+        const double speedup = res.samples_per_sec / results[0].samples_per_sec;
+        if (format == "json") {
+            printf("  {\"threads\": %d, \"chips\": %d, \"voices\": %d, \"samples\": %u, \"seconds\": %.3f, "
+                   "\"samples_per_sec\": %.0f, \"realtime_ratio\": %.2f, \"speedup\": %.2f, \"checksum\": \"%08x\"}%s\n",
+                   res.threads, chip_num, voice_num, block_num * kBlockSize, res.seconds, res.samples_per_sec,
+                   res.samples_per_sec / kRate, speedup, res.checksum, (i + 1 < results.size()) ? "," : "");
+        } else {
+            printf("%d,%d,%d,%u,%.3f,%.0f,%.2f,%.2f,%08x\n",
+                   res.threads, chip_num, voice_num, block_num * kBlockSize, res.seconds, res.samples_per_sec,
+                   res.samples_per_sec / kRate, speedup, res.checksum);
+        }
+        if (res.checksum != results[0].checksum) {
+            status = 1;
+        }
+    }
+    if (format == "json") {
+        printf("]\n");
+    }
+
+    if (status != 0) {
+        fprintf(stderr, "error: the output depends on the number of threads\n");
+    }
+    return status;
+}
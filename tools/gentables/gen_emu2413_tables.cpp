@@ -0,0 +1,148 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+// Generator of the read-only tables of emu2413 (host build)
+//
+// usage: gen_emu2413_tables > emu2413_tables.h
+//
+// The tables used to be built by initializeTables() at the first OPLL_new().
+// They are now emitted as const data so that they can be placed in flash.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace {
+
+const double kPi = 3.14159265358979323846264338327950288;
+
+const int kPgBits = 10;
+const int kPgWidth = 1 << kPgBits;
+
+const double kEgStep = 0.375;
+
+double dB2(double x) {
+    return x * 2;
+}
+
+// key scale level of the upper 4 bits of F-Number
+const double kKlTable[16] = {
+    dB2(0.000),  dB2(9.000),  dB2(12.000), dB2(13.875), dB2(15.000), dB2(16.125), dB2(16.875), dB2(17.625),
+    dB2(18.000), dB2(18.750), dB2(19.125), dB2(19.500), dB2(19.875), dB2(20.250), dB2(20.625), dB2(21.000),
+};
+
+void printTable(const char *type, const char *name, const char *size, const int *values, int num, int columns) {
+    printf("static const %s %s[%s] = {\n", type, name, size);
+    for (int i = 0; i < num; i++) {
+        printf("%5d,%s", values[i], ((i + 1) % columns == 0) ? "\n" : "");
+    }
+    if (num % columns != 0) {
+        printf("\n");
+    }
+    printf("};\n\n");
+}
+
+void makeExpTable() {
+    int table[256];
+    for (int x = 0; x < 256; x++) {
+        table[x] = (int)round((exp2((double)x / 256.0) - 1) * 1024);
+    }
+    printf("/* exp_table[x] = round((exp2((double)x / 256.0) - 1) * 1024) */\n");
+    printTable("uint16_t", "exp_table", "256", table, 256, 16);
+}
+
+void makeSinTables() {
+    int full[kPgWidth];
+    int half[kPgWidth];
+
+    for (int x = 0; x < kPgWidth / 4; x++) {
+        full[x] = (int)round(-log2(sin((x + 0.5) * kPi / (kPgWidth / 4) / 2)) * 256);
+    }
+    for (int x = 0; x < kPgWidth / 4; x++) {
+        full[kPgWidth / 4 + x] = full[kPgWidth / 4 - x - 1];
+    }
+    for (int x = 0; x < kPgWidth / 2; x++) {
+        full[kPgWidth / 2 + x] = 0x8000 | full[x];
+    }
+
+    for (int x = 0; x < kPgWidth / 2; x++) {
+        half[x] = full[x];
+    }
+    for (int x = kPgWidth / 2; x < kPgWidth; x++) {
+        half[x] = 0xfff;
+    }
+
+    printf("/* fullsin_table[x] = round(-log2(sin((x + 0.5) * PI / (PG_WIDTH / 4) / 2)) * 256), bit 15 is the sign */\n");
+    printTable("uint16_t", "fullsin_table", "PG_WIDTH", full, kPgWidth, 16);
+    printf("/* the negative half of halfsin_table is muted */\n");
+    printTable("uint16_t", "halfsin_table", "PG_WIDTH", half, kPgWidth, 16);
+}
+
+void makeKslTable() {
+    int table[8 * 16 * 4];
+
+    for (int fnum = 0; fnum < 16; fnum++) {
+        for (int block = 0; block < 8; block++) {
+            for (int KL = 0; KL < 4; KL++) {
+                int value = 0;
+                if (KL != 0) {
+                    int32_t tmp = (int32_t)(kKlTable[fnum] - dB2(3.000) * (7 - block));
+                    if (tmp > 0) {
+                        value = (int)(uint32_t)((tmp >> (3 - KL)) / kEgStep);
+                    }
+                }
+                table[(((block << 4) | fnum) << 2) | KL] = value;
+            }
+        }
+    }
+
+    printf("/* attenuation by key scale level in EG steps: ksl_table[(block << 4) | (fnum >> 5)][KL] */\n");
+    printf("/* the total level of a slot is TL2EG(TL) + ksl_table[][] */\n");
+    printf("static const uint8_t ksl_table[8 * 16][4] = {\n");
+    for (int i = 0; i < 8 * 16; i++) {
+        printf("{%3d, %3d, %3d, %3d},%s", table[i * 4 + 0], table[i * 4 + 1], table[i * 4 + 2], table[i * 4 + 3],
+               ((i + 1) % 4 == 0) ? "\n" : " ");
+    }
+    printf("};\n\n");
+}
+
+void makeRksTable() {
+    int table[8 * 2 * 2];
+
+    for (int fnum8 = 0; fnum8 < 2; fnum8++) {
+        for (int block = 0; block < 8; block++) {
+            table[(((block << 1) | fnum8) << 1) | 1] = (block << 1) + fnum8;
+            table[(((block << 1) | fnum8) << 1) | 0] = block >> 1;
+        }
+    }
+
+    printf("/* key scale of rate: rks_table[(block << 1) | (fnum >> 8)][KR] */\n");
+    printf("static const uint8_t rks_table[8 * 2][2] = {\n");
+    for (int i = 0; i < 8 * 2; i++) {
+        printf("{%2d, %2d},%s", table[i * 2 + 0], table[i * 2 + 1], ((i + 1) % 8 == 0) ? "\n" : " ");
+    }
+    printf("};\n\n");
+}
+
+}  // namespace
+
+int main() {
+    printf("/*\n");
+    printf(" * Read-only tables of emu2413.\n");
+    printf(" * This file is generated by tools/gentables/gen_emu2413_tables.cpp. Do not edit.\n");
+    printf(" * Regenerate with \"make -C tools tables\".\n");
+    printf(" */\n\n");
+    printf("/* clang-format off */\n");
+
+    makeExpTable();
+    makeSinTables();
+    makeKslTable();
+    makeRksTable();
+
+    printf("/* clang-format on */\n");
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+/*
+ * Adapter between opll_golden and one emu2413 build.
+ * Compiled twice: with GOLDEN_REF for the frozen reference in ref/, and without it
+ * for the engine in the sketch directory.
+ */
+
+#include <string.h>
+
+#include "golden_engine.h"
+
+#ifdef GOLDEN_REF
+#include "ref/emu2413_rename.h"
+#include "ref/emu2413.c"
+#define GOLDEN_ENGINE_NAME "reference"
+#define GOLDEN_ENGINE_VAR golden_ref_engine
+/* the reference keeps the per-slot state in OPLL_SLOT */
+#define SLOT_FIELD(opll, slot, i, field) ((slot)->field)
+#else
+#include "emu2413.h"
+#define GOLDEN_ENGINE_NAME "optimized"
+#define GOLDEN_ENGINE_VAR golden_opt_engine
+#define SLOT_FIELD(opll, slot, i, field) ((opll)->lanes.field[i])
+#endif
+
+static void *create(uint32_t clk, uint32_t rate) {
+  OPLL *opll = OPLL_new(clk, rate);
+  if (opll != NULL) {
+    OPLL_setVoiceNum(opll, 9);
+  }
+  return opll;
+}
+
+static void destroy(void *opll) { OPLL_delete((OPLL *)opll); }
+
+static void writeReg(void *opll, uint32_t reg, uint8_t val) { OPLL_writeReg((OPLL *)opll, reg, val); }
+
+static int16_t calc(void *opll) { return OPLL_calc((OPLL *)opll); }
+
+static int16_t calcNoRateConv(void *opll) { return OPLL_calcNoRateConv((OPLL *)opll); }
+
+#ifdef GOLDEN_REF
+/*
+ * OPLL_calcStereo of the reference, except that the rate converter timer advances
+ * once per output sample. The original advances it at both OPLL_RateConv_getData
+ * calls, which resamples each channel at the wrong phase; the optimized engine
+ * advances it only for ch 0.
+ */
+static void calcStereo(void *p, int32_t out[2]) {
+  OPLL *opll = (OPLL *)p;
+  double timer;
+
+  if (opll->conv == NULL) {
+    OPLL_calcStereo(opll, out);
+    return;
+  }
+
+  while (opll->out_step > opll->out_time) {
+    opll->out_time += opll->inp_step;
+    update_output(opll);
+    mix_output_stereo(opll);
+  }
+  opll->out_time -= opll->out_step;
+  timer = opll->conv->timer;
+  out[0] = OPLL_RateConv_getData(opll->conv, 0);
+  opll->conv->timer = timer;
+  out[1] = OPLL_RateConv_getData(opll->conv, 1);
+}
+
+static void writeRegs(void *opll, const uint16_t *cmds, uint32_t n) {
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    OPLL_writeReg((OPLL *)opll, cmds[i] >> 8, cmds[i] & 0xff);
+  }
+}
+
+static void calcBlock(void *opll, int16_t *out, uint32_t n) {
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    out[i] = OPLL_calc((OPLL *)opll);
+  }
+}
+
+static void calcBlockStereo(void *opll, int16_t *out, uint32_t n) {
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    int32_t s[2];
+    calcStereo(opll, s);
+    out[i * 2 + 0] = (int16_t)s[0];
+    out[i * 2 + 1] = (int16_t)s[1];
+  }
+}
+#else
+static void calcStereo(void *opll, int32_t out[2]) { OPLL_calcStereo((OPLL *)opll, out); }
+
+static void writeRegs(void *opll, const uint16_t *cmds, uint32_t n) { OPLL_writeRegs((OPLL *)opll, cmds, n); }
+
+static void calcBlock(void *opll, int16_t *out, uint32_t n) { OPLL_calcBlock((OPLL *)opll, out, n); }
+
+static void calcBlockStereo(void *opll, int16_t *out, uint32_t n) { OPLL_calcBlockStereo((OPLL *)opll, out, n); }
+#endif
+
+static void setVoiceNum(void *opll, int voices) { OPLL_setVoiceNum((OPLL *)opll, voices); }
+
+#ifdef GOLDEN_REF
+#define setAutoIdle NULL
+#else
+static void setAutoIdle(void *opll, uint8_t enable) { OPLL_setAutoIdle((OPLL *)opll, enable); }
+#endif
+
+static void getState(void *p, GOLDEN_STATE *state) {
+  OPLL *opll = (OPLL *)p;
+  int i;
+
+  memcpy(state->reg, opll->reg, sizeof(state->reg));
+  state->test_flag = opll->test_flag;
+  state->rhythm_mode = opll->rhythm_mode;
+  state->slot_key_status = opll->slot_key_status;
+  state->eg_counter = opll->eg_counter;
+  state->pm_phase = opll->pm_phase;
+  state->am_phase = opll->am_phase;
+  state->lfo_am = opll->lfo_am;
+  state->noise = opll->noise;
+  state->short_noise = opll->short_noise;
+  state->out_time = (uint32_t)opll->out_time;
+
+  for (i = 0; i < 18; i++) {
+    const OPLL_SLOT *slot = &opll->slot[i];
+    GOLDEN_SLOT_STATE *s = &state->slot[i];
+    s->eg_state = slot->eg_state;
+    s->key_flag = slot->key_flag;
+    s->sus_flag = slot->sus_flag;
+    s->patch = (uint8_t)opll->patch_number[i >> 1];
+    s->volume = slot->volume;
+    s->blk_fnum = slot->blk_fnum;
+    s->eg_out = SLOT_FIELD(opll, slot, i, eg_out);
+    s->tll = SLOT_FIELD(opll, slot, i, tll);
+    s->pg_phase = SLOT_FIELD(opll, slot, i, pg_phase);
+    s->pg_out = SLOT_FIELD(opll, slot, i, pg_out);
+    s->output = slot->output[0];
+  }
+}
+
+const GOLDEN_ENGINE GOLDEN_ENGINE_VAR = {
+    GOLDEN_ENGINE_NAME, create,    destroy,         writeReg, writeRegs,   calc,        calcNoRateConv,
+    calcStereo,         calcBlock, calcBlockStereo, getState, setVoiceNum, setAutoIdle,
+};
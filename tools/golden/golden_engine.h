@@ -0,0 +1,78 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+/*
+ * Common interface to the two emu2413 builds compared by opll_golden:
+ * the frozen reference in ref/ (the original emu2413) and the optimized engine in
+ * the sketch directory. The block and batch entries of the reference are emulated
+ * with its per-sample and per-register API.
+ * Both are built from golden_engine.c, so that the OPLL structures of the two
+ * builds never meet in one translation unit.
+ */
+
+#ifndef TOOLS_GOLDEN_GOLDEN_ENGINE_H_
+#define TOOLS_GOLDEN_GOLDEN_ENGINE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* state of a slot printed when the outputs diverge */
+typedef struct __GOLDEN_SLOT_STATE {
+  uint8_t eg_state;
+  uint8_t key_flag;
+  uint8_t sus_flag;
+  uint8_t patch; /* patch number of the channel */
+  int32_t volume;
+  uint16_t blk_fnum;
+  uint16_t eg_out;
+  uint16_t tll;
+  uint32_t pg_phase;
+  uint32_t pg_out;
+  int32_t output;
+} GOLDEN_SLOT_STATE;
+
+typedef struct __GOLDEN_STATE {
+  uint8_t reg[0x40];
+  uint8_t test_flag;
+  uint8_t rhythm_mode;
+  uint32_t slot_key_status;
+  uint32_t eg_counter;
+  uint32_t pm_phase;
+  int32_t am_phase;
+  uint8_t lfo_am;
+  uint32_t noise;
+  uint8_t short_noise;
+  uint32_t out_time;
+  GOLDEN_SLOT_STATE slot[18];
+} GOLDEN_STATE;
+
+typedef struct __GOLDEN_ENGINE {
+  const char *name;
+  void *(*create)(uint32_t clk, uint32_t rate);
+  void (*destroy)(void *opll);
+  void (*writeReg)(void *opll, uint32_t reg, uint8_t val);
+  void (*writeRegs)(void *opll, const uint16_t *cmds, uint32_t n);
+  int16_t (*calc)(void *opll);
+  int16_t (*calcNoRateConv)(void *opll);
+  void (*calcStereo)(void *opll, int32_t out[2]);
+  void (*calcBlock)(void *opll, int16_t *out, uint32_t n);
+  void (*calcBlockStereo)(void *opll, int16_t *out, uint32_t n);
+  void (*getState)(void *opll, GOLDEN_STATE *state);
+  void (*setVoiceNum)(void *opll, int voices);
+  void (*setAutoIdle)(void *opll, uint8_t enable); /* NULL if the engine has no auto-idle */
+} GOLDEN_ENGINE;
+
+extern const GOLDEN_ENGINE golden_ref_engine;
+extern const GOLDEN_ENGINE golden_opt_engine;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TOOLS_GOLDEN_GOLDEN_ENGINE_H_ */
@@ -0,0 +1,729 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+// Bit-exact regression check of emu2413 (host build)
+//
+// Replays register-write logs through the frozen reference engine (ref/, the
+// original emu2413 of this project) and the engine in the sketch directory, and
+// compares the output sample streams. The optimized engine is driven through
+// several paths of its API:
+//   calc    OPLL_writeReg + OPLL_calc per sample (same calls as the reference)
+//   block   OPLL_writeReg + OPLL_calcBlock in blocks of up to 240 samples
+//   batch   the writes between two renders in one OPLL_writeRegs + OPLL_calcBlock
+//   stereo  OPLL_writeReg + OPLL_calcBlockStereo, against OPLL_calcStereo
+//   noconv  OPLL_writeReg + OPLL_calcNoRateConv on both engines
+//   idle9   OPLL_calcBlock with OPLL_setAutoIdle on, against the optimized engine
+//           with auto-idle off, both at 9 voices
+//   idle6   the same at 6 voices (as FMTGSink runs with fewer voices, rhythm mode
+//           included)
+// The outputs must match bit for bit, except on the first four paths when the log
+// enables the rate converter: the optimized engine has its own (integer) converter,
+// so those are compared by the SNR of the difference, which must be at least
+// kMinSnrDb. The noconv path still checks the chip-rate output of those logs bit
+// for bit. Auto-idle freezes the envelope and phase of an idle channel, so the idle
+// paths are always compared by SNR, against kMinIdle9SnrDb / kMinIdle6SnrDb. For a
+// bit-exact path the first diverging sample is reported together with the chip and
+// slot state of both engines. The exit status is 1 if any check fails.
+//
+// Log format (text, one command per line, '#' starts a comment):
+//   clock <hz>         input clock (default: 3579545), before the first w / s
+//   rate <hz>          output sampling rate (default: 49716), before the first w / s
+//   w <reg> <val>      register write, both in hex
+//   s <n>              render n output samples
+//
+// usage: opll_golden [-f csv|json] [-p path] log...
+//        opll_golden -g dir
+//   -f  output format (default: csv)
+//   -p  path to check: all, calc, block, batch, stereo, noconv, idle9, idle6 (default: all)
+//   -g  write the generated corpus (all patches, rhythm mode, test register and
+//       random writes, each with the rate converter on and off) to dir
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "golden_engine.h"
+
+namespace {
+
+const uint32_t kBlockSize = 240;
+
+// lower limit of the SNR of the optimized engine against the reference with the rate converter
+const double kMinSnrDb = 40.0;
+
+// lower limits of the SNR of the optimized engine with auto-idle on against auto-idle off, at 9 and 6 voices.
+// The worst logs are the random writes, where rhythm mode and the test register make idle channels audible again
+// without a key-on (about 10 dB at 9 voices and 17 dB at 6 voices); the other logs measure 26 dB or better.
+const double kMinIdle9SnrDb = 8.0;
+const double kMinIdle6SnrDb = 15.0;
+
+enum Path {
+    kPathCalc,
+    kPathBlock,
+    kPathBatch,
+    kPathStereo,
+    kPathNoConv,
+    kPathIdle9,
+    kPathIdle6,
+    kPathNum
+};
+
+const char *kPathName[kPathNum] = {
+    "calc",
+    "block",
+    "batch",
+    "stereo",
+    "noconv",
+    "idle9",
+    "idle6",
+};
+
+// number of voices of the idle paths (0: not an idle path)
+int IdleVoices(Path path) {
+    switch (path) {
+    case kPathIdle9:
+        return 9;
+    case kPathIdle6:
+        return 6;
+    default:
+        return 0;
+    }
+}
+
+// same settings as opll_bench
+struct RateSetting {
+    const char *name;
+    uint32_t clk;
+    uint32_t rate;
+};
+
+const RateSetting kRates[] = {
+    { "spresense", 3456000, 48000 },
+    { "native",    3579545, 49716 },
+    { "48k",       3579545, 48000 },
+    { "44k",       3579545, 44100 },
+};
+const int kRateNum = sizeof(kRates) / sizeof(kRates[0]);
+
+/*----------------------------------------------------------------------------*/
+// register-write log
+
+struct LogCommand {
+    bool render;     // false: register write
+    uint32_t value;  // render: number of samples, write: (reg << 8) | val
+    int line;
+};
+
+struct Log {
+    std::string path;
+    uint32_t clk = 3579545;
+    uint32_t rate = 49716;
+    std::vector<LogCommand> commands;
+    uint32_t sample_num = 0;
+    uint32_t write_num = 0;
+};
+
+bool LoadLog(const char *path, Log *log) {
+    FILE *fp = fopen(path, "r");
+    if (fp == nullptr) {
+        perror(path);
+        return false;
+    }
+
+    log->path = path;
+    char buf[256];
+    int line = 0;
+    bool ok = true;
+    while (ok && fgets(buf, sizeof(buf), fp) != nullptr) {
+        line++;
+        char *comment = strchr(buf, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        char op[16];
+        unsigned a, b;
+        const int n = sscanf(buf, "%15s", op);
+        if (n != 1) {
+            continue;  // empty line
+        }
+
+        if (!strcmp(op, "w") && sscanf(buf, "%*s %x %x", &a, &b) == 2 && a < 0x40 && b < 0x100) {
+            log->commands.push_back({ false, (a << 8) | b, line });
+            log->write_num++;
+        } else if (!strcmp(op, "s") && sscanf(buf, "%*s %u", &a) == 1) {
+            log->commands.push_back({ true, a, line });
+            log->sample_num += a;
+        } else if (!strcmp(op, "clock") && sscanf(buf, "%*s %u", &a) == 1 && log->commands.empty() && a > 0) {
+            log->clk = a;
+        } else if (!strcmp(op, "rate") && sscanf(buf, "%*s %u", &a) == 1 && log->commands.empty() && a > 0) {
+            log->rate = a;
+        } else {
+            fprintf(stderr, "%s:%d: syntax error\n", path, line);
+            ok = false;
+        }
+    }
+
+    fclose(fp);
+    return ok;
+}
+
+/*----------------------------------------------------------------------------*/
+// replay
+
+struct Divergence {
+    uint32_t sample;  // index of the first diverging output sample
+    int line;         // line of the log which rendered it
+    int channel;      // 0: mono / left, 1: right
+    int32_t ref;
+    int32_t opt;
+    GOLDEN_STATE ref_state;
+    GOLDEN_STATE opt_state;
+};
+
+// power of the reference output and of the difference, for the paths compared by SNR
+struct Noise {
+    double signal = 0;
+    double error = 0;
+
+    double snrDb() const {
+        if (error == 0) {
+            return INFINITY;
+        }
+        return 10.0 * log10((signal > 0 ? signal : 1.0) / error);
+    }
+};
+
+// renders n samples of the reference into ref[] (interleaved when stereo)
+void RenderReference(const GOLDEN_ENGINE &engine, void *opll, Path path, int32_t *ref, uint32_t n) {
+    if (IdleVoices(path)) {
+        int16_t buf[kBlockSize];
+        engine.calcBlock(opll, buf, n);
+        for (uint32_t i = 0; i < n; i++) {
+            ref[i] = buf[i];
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (path == kPathStereo) {
+            engine.calcStereo(opll, &ref[i * 2]);
+        } else if (path == kPathNoConv) {
+            ref[i] = engine.calcNoRateConv(opll);
+        } else {
+            ref[i] = engine.calc(opll);
+        }
+    }
+}
+
+void RenderOptimized(const GOLDEN_ENGINE &engine, void *opll, Path path, int32_t *opt, uint32_t n) {
+    int16_t buf[kBlockSize * 2];
+
+    switch (path) {
+    case kPathCalc:
+        for (uint32_t i = 0; i < n; i++) {
+            opt[i] = engine.calc(opll);
+        }
+        break;
+    case kPathBlock:
+    case kPathBatch:
+    case kPathIdle9:
+    case kPathIdle6:
+        engine.calcBlock(opll, buf, n);
+        for (uint32_t i = 0; i < n; i++) {
+            opt[i] = buf[i];
+        }
+        break;
+    case kPathStereo:
+        engine.calcBlockStereo(opll, buf, n);
+        for (uint32_t i = 0; i < n * 2; i++) {
+            opt[i] = buf[i];
+        }
+        break;
+    case kPathNoConv:
+        for (uint32_t i = 0; i < n; i++) {
+            opt[i] = engine.calcNoRateConv(opll);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Replays the log through both engines and returns false at the first diverging sample, filling *div.
+// If stop is not 0, stops after that many samples instead and takes the state of both engines there.
+// If noise is not null, replays the whole log and only adds up the power of the output and of the difference.
+// The idle paths replay it through the optimized engine twice, with auto-idle off as the reference.
+bool Replay(const Log &log, Path path, uint32_t stop, Divergence *div, Noise *noise = nullptr) {
+    const GOLDEN_ENGINE &ref_engine = IdleVoices(path) ? golden_opt_engine : golden_ref_engine;
+    const GOLDEN_ENGINE &opt_engine = golden_opt_engine;
+    void *ref = ref_engine.create(log.clk, log.rate);
+    void *opt = opt_engine.create(log.clk, log.rate);
+    if (IdleVoices(path)) {
+        ref_engine.setVoiceNum(ref, IdleVoices(path));
+        opt_engine.setVoiceNum(opt, IdleVoices(path));
+        opt_engine.setAutoIdle(opt, 1);
+    }
+    const int ch_num = (path == kPathStereo) ? 2 : 1;
+
+    std::vector<uint16_t> cmds;
+    int32_t ref_out[kBlockSize * 2];
+    int32_t opt_out[kBlockSize * 2];
+    uint32_t sample = 0;
+    bool same = true;
+
+    for (size_t c = 0; c < log.commands.size() && same && (stop == 0 || sample < stop); c++) {
+        const LogCommand &cmd = log.commands[c];
+        if (!cmd.render) {
+            ref_engine.writeReg(ref, cmd.value >> 8, cmd.value & 0xff);
+            if (path == kPathBatch) {
+                cmds.push_back(cmd.value);
+            } else {
+                opt_engine.writeReg(opt, cmd.value >> 8, cmd.value & 0xff);
+            }
+            continue;
+        }
+
+        if (!cmds.empty()) {
+            opt_engine.writeRegs(opt, cmds.data(), cmds.size());
+            cmds.clear();
+        }
+
+        for (uint32_t left = cmd.value; left > 0 && same && (stop == 0 || sample < stop);) {
+            uint32_t n = (left < kBlockSize) ? left : kBlockSize;
+            if (stop != 0 && n > stop - sample) {
+                n = stop - sample;
+            }
+            RenderReference(ref_engine, ref, path, ref_out, n);
+            RenderOptimized(opt_engine, opt, path, opt_out, n);
+
+            for (uint32_t i = 0; i < n * ch_num; i++) {
+                if (noise) {
+                    const double d = (double)opt_out[i] - ref_out[i];
+                    noise->signal += (double)ref_out[i] * ref_out[i];
+                    noise->error += d * d;
+                } else if (ref_out[i] != opt_out[i]) {
+                    div->sample = sample + i / ch_num;
+                    div->line = cmd.line;
+                    div->channel = i % ch_num;
+                    div->ref = ref_out[i];
+                    div->opt = opt_out[i];
+                    same = false;
+                    break;
+                }
+            }
+            sample += n;
+            left -= n;
+        }
+    }
+
+    if (stop != 0) {
+        ref_engine.getState(ref, &div->ref_state);
+        opt_engine.getState(opt, &div->opt_state);
+    }
+
+    ref_engine.destroy(ref);
+    opt_engine.destroy(opt);
+    return same;
+}
+
+// replays the log again up to the diverging sample, so that the state is taken right after it
+void CaptureState(const Log &log, Path path, Divergence *div) {
+    Divergence tmp;
+    Replay(log, path, div->sample + 1, &tmp);
+    div->ref_state = tmp.ref_state;
+    div->opt_state = tmp.opt_state;
+}
+
+bool IsSameSlot(const GOLDEN_SLOT_STATE &a, const GOLDEN_SLOT_STATE &b) {
+    return a.eg_state == b.eg_state && a.key_flag == b.key_flag && a.sus_flag == b.sus_flag && a.patch == b.patch &&
+           a.volume == b.volume && a.blk_fnum == b.blk_fnum && a.eg_out == b.eg_out && a.tll == b.tll &&
+           a.pg_phase == b.pg_phase && a.pg_out == b.pg_out && a.output == b.output;
+}
+
+void PrintValue(const char *name, long ref, long opt) {
+    fprintf(stderr, "  %-16s %10ld %10ld%s\n", name, ref, opt, (ref != opt) ? "  *" : "");
+}
+
+void PrintDivergence(const Log &log, Path path, const Divergence &div) {
+    const GOLDEN_STATE &r = div.ref_state;
+    const GOLDEN_STATE &o = div.opt_state;
+
+    fprintf(stderr, "%s: path %s: first divergence at sample %u (%s, rendered by line %d): reference %d, optimized %d\n",
+            log.path.c_str(), kPathName[path], div.sample, (path == kPathStereo) ? (div.channel ? "R" : "L") : "mono",
+            div.line, div.ref, div.opt);
+    fprintf(stderr, "state after sample %u (* marks differences)\n", div.sample);
+    fprintf(stderr, "  %-16s %10s %10s\n", "", "reference", "optimized");
+    for (int i = 0; i < 0x40; i++) {
+        if (r.reg[i] != o.reg[i]) {
+            char name[16];
+            snprintf(name, sizeof(name), "reg[0x%02x]", i);
+            PrintValue(name, r.reg[i], o.reg[i]);
+        }
+    }
+    PrintValue("test_flag", r.test_flag, o.test_flag);
+    PrintValue("rhythm_mode", r.rhythm_mode, o.rhythm_mode);
+    PrintValue("slot_key_status", r.slot_key_status, o.slot_key_status);
+    PrintValue("eg_counter", r.eg_counter, o.eg_counter);
+    PrintValue("pm_phase", r.pm_phase, o.pm_phase);
+    PrintValue("am_phase", r.am_phase, o.am_phase);
+    PrintValue("lfo_am", r.lfo_am, o.lfo_am);
+    PrintValue("noise", r.noise, o.noise);
+    PrintValue("short_noise", r.short_noise, o.short_noise);
+    PrintValue("out_time", r.out_time, o.out_time);
+
+    fprintf(stderr, "  slot   eg_state key sus patch volume blk_fnum eg_out  tll pg_phase pg_out output\n");
+    for (int i = 0; i < 18; i++) {
+        const GOLDEN_SLOT_STATE *s[2] = { &r.slot[i], &o.slot[i] };
+        const bool diff = !IsSameSlot(*s[0], *s[1]);
+        for (int k = 0; k < 2; k++) {
+            fprintf(stderr, "  %2d %s %8u %3u %3u %5u %6d %8u %6u %4u %8u %6u %6d%s\n",
+                    i, k ? "opt" : "ref", s[k]->eg_state, s[k]->key_flag, s[k]->sus_flag, s[k]->patch, s[k]->volume,
+                    s[k]->blk_fnum, s[k]->eg_out, s[k]->tll, s[k]->pg_phase, s[k]->pg_out, s[k]->output,
+                    (diff && k) ? "  *" : "");
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+// corpus
+
+class LogWriter {
+public:
+    LogWriter() : fp_(nullptr), seed_(1) {
+    }
+
+    ~LogWriter() {
+        close();
+    }
+
+    bool open(const std::string &path, const RateSetting &rate, const char *comment, uint32_t seed) {
+        fp_ = fopen(path.c_str(), "w");
+        if (fp_ == nullptr) {
+            return false;
+        }
+        fprintf(fp_, "# %s (%s)\nclock %u\nrate %u\n", comment, rate.name, rate.clk, rate.rate);
+        seed_ = seed;
+        return true;
+    }
+
+    void close() {
+        if (fp_) {
+            fclose(fp_);
+            fp_ = nullptr;
+        }
+    }
+
+    void write(int reg, int val) { fprintf(fp_, "w %02x %02x\n", reg, val & 0xff); }
+    void render(uint32_t n) { fprintf(fp_, "s %u\n", n); }
+    void comment(const char *text) { fprintf(fp_, "# %s\n", text); }
+
+    // deterministic pseudo random number in [0, n)
+    uint32_t random(uint32_t n) {
+        seed_ = seed_ * 1103515245 + 12345;
+        return (seed_ >> 8) % n;
+    }
+
+private:
+    FILE *fp_;
+    uint32_t seed_;
+};
+
+// block (3 bits) and f-number (9 bits) of a note in the middle octaves
+void KeyOn(LogWriter &w, int ch, int inst, int vol, bool sus) {
+    const int fnum = 0x100 + w.random(0xa0);
+    const int blk = 2 + w.random(4);
+    w.write(0x30 + ch, (inst << 4) | vol);
+    w.write(0x10 + ch, fnum & 0xff);
+    w.write(0x20 + ch, (sus ? 0x20 : 0) | 0x10 | (blk << 1) | (fnum >> 8));
+}
+
+void KeyOff(LogWriter &w, int ch, bool sus) {
+    w.write(0x20 + ch, sus ? 0x20 : 0x00);
+}
+
+// every patch including the user patch, on every channel, with and without sustain
+void GeneratePatches(LogWriter &w) {
+    for (int inst = 0; inst < 16; inst++) {
+        char text[32];
+        snprintf(text, sizeof(text), "patch %d", inst);
+        w.comment(text);
+        if (inst == 0) {
+            for (int reg = 0; reg < 8; reg++) {
+                w.write(reg, w.random(0x100));
+            }
+        }
+        const bool sus = (inst & 1);
+        for (int ch = 0; ch < 9; ch++) {
+            KeyOn(w, ch, inst, w.random(16), sus);
+            w.render(w.random(40));
+        }
+        w.render(2000);
+        for (int ch = 0; ch < 9; ch++) {
+            KeyOff(w, ch, sus);
+        }
+        w.render(3000);
+    }
+}
+
+// rhythm mode on and off, with the melody channels 7 to 9 both sounding and silent
+void GenerateRhythm(LogWriter &w) {
+    static const int kFnum[3] = { 0x20, 0x50, 0xc0 };
+    static const int kBlock[3] = { 0x05, 0x05, 0x01 };
+
+    w.comment("melody notes on ch 7-9, then rhythm mode");
+    for (int ch = 6; ch < 9; ch++) {
+        KeyOn(w, ch, 3 + ch, 0, false);
+    }
+    w.render(1000);
+    for (int ch = 6; ch < 9; ch++) {
+        w.write(0x16 + ch - 6, kFnum[ch - 6]);
+        w.write(0x26 + ch - 6, kBlock[ch - 6]);
+        w.write(0x36 + ch - 6, w.random(0x100));
+    }
+
+    for (int i = 0; i < 120; i++) {
+        const uint32_t r = w.random(16);
+        if (r == 0) {
+            w.write(0x0e, 0x00);  // back to melody mode
+        } else if (r == 1) {
+            w.write(0x36 + w.random(3), w.random(0x100));
+        } else if (r == 2) {
+            const int ch = 6 + w.random(3);
+            w.write(0x16 + ch - 6, w.random(0x100));
+            w.write(0x26 + ch - 6, w.random(0x40));
+        } else {
+            w.write(0x0e, 0x20 | w.random(0x20));
+        }
+        w.render(w.random(1500));
+    }
+    w.write(0x0e, 0x20);
+    w.render(4000);
+    w.write(0x0e, 0x00);
+    w.render(2000);
+}
+
+// the test register while notes and rhythm sounds are playing
+void GenerateTestRegister(LogWriter &w) {
+    static const int kValues[] = { 0x01, 0x02, 0x04, 0x08, 0x03, 0x05, 0x06, 0x0c, 0x0f, 0xff };
+
+    for (int ch = 0; ch < 6; ch++) {
+        KeyOn(w, ch, 1 + ch * 2, w.random(8), false);
+    }
+    w.write(0x16, 0x20);
+    w.write(0x26, 0x05);
+    w.write(0x36, 0x00);
+    w.write(0x0e, 0x3f);
+    w.render(500);
+
+    for (size_t i = 0; i < sizeof(kValues) / sizeof(kValues[0]); i++) {
+        char text[32];
+        snprintf(text, sizeof(text), "test register 0x%02x", kValues[i]);
+        w.comment(text);
+        w.write(0x0f, kValues[i]);
+        w.render(50 + w.random(500));
+        KeyOn(w, w.random(6), 1 + w.random(15), w.random(16), false);
+        w.write(0x0e, 0x20 | w.random(0x20));
+        w.render(50 + w.random(500));
+        w.write(0x0f, 0x00);
+        w.render(500);
+    }
+
+    for (int ch = 0; ch < 6; ch++) {
+        KeyOff(w, ch, false);
+    }
+    w.write(0x0e, 0x20);
+    w.render(3000);
+}
+
+// random writes to every register, often several between two samples
+void GenerateRandom(LogWriter &w) {
+    for (int i = 0; i < 3000; i++) {
+        const uint32_t r = w.random(100);
+        int reg;
+        if (r < 2) {
+            reg = 0x0f;
+        } else if (r < 8) {
+            reg = 0x0e;
+        } else if (r < 16) {
+            reg = w.random(8);
+        } else {
+            reg = 0x10 + w.random(0x30);
+        }
+        int val = w.random(0x100);
+        if (reg == 0x0f) {
+            val = (w.random(4) == 0) ? val : 0x00;
+        }
+        w.write(reg, val);
+        if (w.random(4) == 0) {
+            w.render(w.random(300));
+        }
+    }
+    w.write(0x0f, 0x00);
+    w.write(0x0e, 0x00);
+    for (int ch = 0; ch < 9; ch++) {
+        KeyOff(w, ch, false);
+    }
+    w.render(5000);
+}
+
+struct Scenario {
+    const char *name;
+    const char *comment;
+    void (*generate)(LogWriter &w);
+};
+
+const Scenario kScenarios[] = {
+    { "patches", "all patches on all channels", GeneratePatches },
+    { "rhythm",  "rhythm mode",                 GenerateRhythm },
+    { "testreg", "test register 0x0f",          GenerateTestRegister },
+    { "random",  "random register writes",      GenerateRandom },
+};
+
+bool GenerateCorpus(const char *dir) {
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        perror(dir);
+        return false;
+    }
+
+    for (size_t s = 0; s < sizeof(kScenarios) / sizeof(kScenarios[0]); s++) {
+        for (int r = 0; r < kRateNum; r++) {
+            const std::string path = std::string(dir) + "/" + kScenarios[s].name + "_" + kRates[r].name + ".log";
+            LogWriter w;
+            if (!w.open(path, kRates[r], kScenarios[s].comment, 1 + s)) {
+                perror(path.c_str());
+                return false;
+            }
+            kScenarios[s].generate(w);
+            w.close();
+            printf("%s\n", path.c_str());
+        }
+    }
+    return true;
+}
+
+void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-f csv|json] [-p all|calc|block|batch|stereo|noconv|idle9|idle6] log...\n", name);
+    fprintf(stderr, "       %s -g dir\n", name);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    std::string format = "csv";
+    std::string path_name = "all";
+    const char *corpus_dir = nullptr;
+    std::vector<const char *> log_paths;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            format = argv[++i];
+        } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            path_name = argv[++i];
+        } else if (!strcmp(argv[i], "-g") && i + 1 < argc) {
+            corpus_dir = argv[++i];
+        } else if (argv[i][0] != '-') {
+            log_paths.push_back(argv[i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (corpus_dir) {
+        return GenerateCorpus(corpus_dir) ? 0 : 1;
+    }
+
+    bool run[kPathNum];
+    bool path_valid = (path_name == "all");
+    for (int p = 0; p < kPathNum; p++) {
+        run[p] = (path_name == "all" || path_name == kPathName[p]);
+        path_valid |= (path_name == kPathName[p]);
+    }
+    if ((format != "csv" && format != "json") || !path_valid || log_paths.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (format == "csv") {
+        printf("log,path,clock,rate,rate_conv,samples,writes,result,first_diff,snr_db\n");
+    } else {
+        printf("[\n");
+    }
+
+    bool all_same = true;
+    bool first_row = true;
+    for (const char *log_path : log_paths) {
+        Log log;
+        if (!LoadLog(log_path, &log)) {
+            return 1;
+        }
+        // same condition as emu2413 uses to enable its rate converter
+        const double f_inp = log.clk / 72.0;
+        const bool rate_conv = ((uint32_t)f_inp != log.rate && (uint32_t)(f_inp + 0.5) != log.rate);
+
+        for (int p = 0; p < kPathNum; p++) {
+            if (!run[p]) {
+                continue;
+            }
+            Divergence div;
+            bool same;
+            const char *result;
+            long first_diff = -1;
+            double snr_db = INFINITY;  // printed as -1 (no SNR) for the bit-exact paths
+            const bool by_snr = IdleVoices((Path)p) || (rate_conv && p != kPathNoConv);
+            if (by_snr) {
+                const double min_snr_db =
+                    (p == kPathIdle9) ? kMinIdle9SnrDb : ((p == kPathIdle6) ? kMinIdle6SnrDb : kMinSnrDb);
+                Noise noise;
+                Replay(log, (Path)p, 0, &div, &noise);
+                snr_db = noise.snrDb();
+                same = (snr_db >= min_snr_db);
+                result = same ? "ok" : "noisy";
+                if (!same) {
+                    fprintf(stderr, "%s: path %s: SNR %.1f dB against the reference is below %.1f dB\n",
+                            log_path, kPathName[p], snr_db, min_snr_db);
+                }
+            } else {
+                same = Replay(log, (Path)p, 0, &div);
+                result = same ? "ok" : "diverged";
+                if (!same) {
+                    CaptureState(log, (Path)p, &div);
+                    PrintDivergence(log, (Path)p, div);
+                    first_diff = div.sample;
+                }
+            }
+            all_same &= same;
+
+            // -1: compared bit for bit, 999: no difference at all
+            const double snr_out = by_snr ? (isinf(snr_db) ? 999.0 : snr_db) : -1.0;
+            if (format == "json") {
+                printf("%s  {\"log\": \"%s\", \"path\": \"%s\", \"clock\": %u, \"rate\": %u, \"rate_conv\": %s, "
+                       "\"samples\": %u, \"writes\": %u, \"result\": \"%s\", \"first_diff\": %ld, \"snr_db\": %.1f}",
+                       first_row ? "" : ",\n", log_path, kPathName[p], log.clk, log.rate, rate_conv ? "true" : "false",
+                       log.sample_num, log.write_num, result, first_diff, snr_out);
+            } else {
+                printf("%s,%s,%u,%u,%d,%u,%u,%s,%ld,%.1f\n",
+                       log_path, kPathName[p], log.clk, log.rate, rate_conv ? 1 : 0,
+                       log.sample_num, log.write_num, result, first_diff, snr_out);
+            }
+            first_row = false;
+        }
+    }
+
+    if (format == "json") {
+        printf("\n]\n");
+    }
+
+    return all_same ? 0 : 1;
+}
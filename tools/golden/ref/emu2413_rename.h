@@ -0,0 +1,51 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+/*
+ * The files in this directory are a frozen copy of the original emu2413.c and
+ * emu2413.h of this project, before any of the optimizations (block API, slot
+ * lanes, active channel tracking, integer rate converter, generated tables, batched
+ * register writes, ...). They are the reference which the optimized engine must
+ * match bit for bit (within the SNR limit of opll_golden when the rate converter
+ * is used), so do not edit them when the engine changes.
+ *
+ * Included before ref/emu2413.c to move its external symbols out of the way of the
+ * engine in the sketch directory, which is linked into the same program.
+ */
+
+#ifndef TOOLS_GOLDEN_REF_EMU2413_RENAME_H_
+#define TOOLS_GOLDEN_REF_EMU2413_RENAME_H_
+
+#define OPLL_RateConv_new REF_OPLL_RateConv_new
+#define OPLL_RateConv_reset REF_OPLL_RateConv_reset
+#define OPLL_RateConv_putData REF_OPLL_RateConv_putData
+#define OPLL_RateConv_getData REF_OPLL_RateConv_getData
+#define OPLL_RateConv_delete REF_OPLL_RateConv_delete
+#define OPLL_new REF_OPLL_new
+#define OPLL_delete REF_OPLL_delete
+#define OPLL_reset REF_OPLL_reset
+#define OPLL_resetPatch REF_OPLL_resetPatch
+#define OPLL_setRate REF_OPLL_setRate
+#define OPLL_setQuality REF_OPLL_setQuality
+#define OPLL_setPan REF_OPLL_setPan
+#define OPLL_setPanFine REF_OPLL_setPanFine
+#define OPLL_setChipType REF_OPLL_setChipType
+#define OPLL_writeIO REF_OPLL_writeIO
+#define OPLL_writeReg REF_OPLL_writeReg
+#define OPLL_calc REF_OPLL_calc
+#define OPLL_calcStereo REF_OPLL_calcStereo
+#define OPLL_calcNoRateConv REF_OPLL_calcNoRateConv
+#define OPLL_setPatch REF_OPLL_setPatch
+#define OPLL_copyPatch REF_OPLL_copyPatch
+#define OPLL_forceRefresh REF_OPLL_forceRefresh
+#define OPLL_dumpToPatch REF_OPLL_dumpToPatch
+#define OPLL_patchToDump REF_OPLL_patchToDump
+#define OPLL_getDefaultPatch REF_OPLL_getDefaultPatch
+#define OPLL_setMask REF_OPLL_setMask
+#define OPLL_toggleMask REF_OPLL_toggleMask
+#define OPLL_setVoiceNum REF_OPLL_setVoiceNum
+
+#endif /* TOOLS_GOLDEN_REF_EMU2413_RENAME_H_ */
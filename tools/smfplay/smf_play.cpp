@@ -0,0 +1,336 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+// Standard MIDI File player (host build)
+//
+// Runs the same SmfSequencer, VoiceAllocator and PitchTable as the sketch and
+// renders the song as fast as possible, applying each event at its exact
+// sample offset. Reports how many voices the song needs (peak number of
+// simultaneously held notes), how many notes were stolen with the given voice
+// count, and the realtime factor. The file is read through mmap.
+//
+// usage: smf_play [-f csv|json] [-c chips] [-v voices] [-i inst] [-o out.wav] file.mid
+//   -f  output format (default: csv)
+//   -c  number of OPLL chips (default: 1)
+//   -v  voices per chip (default: 3, FMTGSINK_MAX_VOICES)
+//   -i  instrument number used on every channel (default: 1, Violin)
+//   -o  write the rendered audio to a 16-bit mono WAV file
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+
+extern "C" {
+#include "emu2413.h"
+}
+
+#include "PitchTable.h"
+#include "SmfSequencer.h"
+#include "VoiceAllocator.h"
+#include "common/wav_writer.h"
+
+namespace {
+
+// same settings as FMTGSink
+const uint32_t kRate = 48000;
+const uint32_t kClk = kRate * 72;
+const int kBlockSize = 240;
+const int kFnumA4 = 440 * 262144LL * 72 / kClk / 16;
+const int kMaxChips = 8;
+
+// the note on/off and pitch bend handling of FMTGSink, without the Spresense dependencies
+class Synth {
+public:
+    Synth(int chip_num, int voice_num, int inst)
+        : chip_num_(chip_num), inst_(inst), steals_(0), held_(0), peak_held_(0) {
+        uint32_t mask = 0;
+        for (int ch = voice_num; ch < 9; ch++) {
+            mask |= OPLL_MASK_CH(ch);
+        }
+        for (int c = 0; c < chip_num_; c++) {
+            opll_[c] = OPLL_new(kClk, kRate);
+            OPLL_setVoiceNum(opll_[c], voice_num);
+            OPLL_setAutoIdle(opll_[c], 1);
+            OPLL_setMask(opll_[c], mask);
+        }
+        allocator_.reset(chip_num * voice_num, chip_num);
+        pitch_table_.init(kFnumA4);
+        memset(bend_, 0, sizeof(bend_));
+        memset(voice_bf_, 0, sizeof(voice_bf_));
+        memset(held_notes_, 0, sizeof(held_notes_));
+
+        mix_shift_ = 0;
+        while ((9 << mix_shift_) < chip_num * voice_num) {
+            mix_shift_++;
+        }
+    }
+
+    ~Synth() {
+        for (int c = 0; c < chip_num_; c++) {
+            OPLL_delete(opll_[c]);
+        }
+    }
+
+    void dispatch(const SmfEvent &event) {
+        const uint8_t channel = event.status & 0x0f;
+        switch (event.status & 0xf0) {
+        case 0x90:
+            if (event.data2 != 0) {
+                noteOn(event.data1, event.data2, channel);
+            } else {
+                noteOff(event.data1, channel);
+            }
+            break;
+        case 0x80:
+            noteOff(event.data1, channel);
+            break;
+        case 0xe0:
+            // default bend range of FMTGSink (2 semitones)
+            bend_[channel] = ((((event.data2 << 7) | event.data1) - 8192) * (2 << PitchTable::kFracBits)) / 8192;
+            updatePitch(channel);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void render(int16_t *out, int n) {
+        int32_t mix[kBlockSize];
+        for (int i = 0; i < n; i++) {
+            mix[i] = 0;
+        }
+        for (int c = 0; c < chip_num_; c++) {
+            OPLL_calcBlock(opll_[c], out, n);
+            for (int i = 0; i < n; i++) {
+                mix[i] += out[i];
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            const int32_t v = mix[i] >> mix_shift_;
+            out[i] = (v > 32767) ? 32767 : ((v < -32768) ? -32768 : v);
+        }
+    }
+
+    uint32_t getSteals() const { return steals_; }
+    int getPeakHeld() const { return peak_held_; }
+
+private:
+    OPLL *opll_[kMaxChips];
+    int chip_num_;
+    int inst_;
+    int mix_shift_;
+    VoiceAllocator allocator_;
+    PitchTable pitch_table_;
+    int32_t bend_[16];
+    uint16_t voice_bf_[VoiceAllocator::kMaxVoices];
+
+    uint32_t steals_;
+    uint8_t held_notes_[16][128];  // note on count of each (channel, note), regardless of the voice count
+    int held_;
+    int peak_held_;
+
+    OPLL *getChip(int voice) { return opll_[voice % chip_num_]; }
+    int getChipCh(int voice) { return voice / chip_num_; }
+
+    void noteOn(uint8_t note, uint8_t velocity, uint8_t channel) {
+        held_notes_[channel][note]++;
+        if (++held_ > peak_held_) {
+            peak_held_ = held_;
+        }
+
+        bool steal;
+        const int voice = allocator_.noteOn(note, channel, &steal);
+        if (voice == VoiceAllocator::kInvalidVoice) {
+            return;
+        }
+        if (steal) {
+            steals_++;
+        }
+
+        const int ch = getChipCh(voice);
+        const int bf = pitch_table_.getBlockFnum((note << PitchTable::kFracBits) + bend_[channel]);
+        voice_bf_[voice] = bf;
+        const uint16_t cmds[] = {
+            OPLL_REG_CMD(0x20 + ch, 0x00),
+            OPLL_REG_CMD(0x30 + ch, (inst_ << 4) | ((0x0f - (velocity >> 3)) & 0x0f)),
+            OPLL_REG_CMD(0x10 + ch, bf & 0xff),
+            OPLL_REG_CMD(0x20 + ch, 0x10 | (bf >> 8)),
+        };
+        OPLL_writeRegs(getChip(voice), steal ? cmds : cmds + 1, steal ? 4 : 3);
+    }
+
+    void noteOff(uint8_t note, uint8_t channel) {
+        if (held_notes_[channel][note] > 0) {
+            held_notes_[channel][note]--;
+            held_--;
+        }
+
+        const int voice = allocator_.noteOff(note, channel);
+        if (voice != VoiceAllocator::kInvalidVoice) {
+            OPLL_writeReg(getChip(voice), 0x20 + getChipCh(voice), voice_bf_[voice] >> 8);
+        }
+    }
+
+    void updatePitch(uint8_t channel) {
+        for (int voice = 0; voice < allocator_.getVoiceNum(); voice++) {
+            const uint8_t note = allocator_.getNote(voice);
+            if (note > 127 || allocator_.getChannel(voice) != channel) {
+                continue;
+            }
+            const uint16_t bf = pitch_table_.getBlockFnum((note << PitchTable::kFracBits) + bend_[channel]);
+            if (bf == voice_bf_[voice]) {
+                continue;
+            }
+            voice_bf_[voice] = bf;
+            const int ch = getChipCh(voice);
+            const uint16_t cmds[] = {
+                OPLL_REG_CMD(0x10 + ch, bf & 0xff),
+                OPLL_REG_CMD(0x20 + ch, (allocator_.isKeyOn(voice) ? 0x10 : 0x00) | (bf >> 8)),
+            };
+            OPLL_writeRegs(getChip(voice), cmds, 2);
+        }
+    }
+};
+
+void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-f csv|json] [-c chips] [-v voices] [-i inst] [-o out.wav] file.mid\n", name);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    std::string format = "csv";
+    int chip_num = 1;
+    int voice_num = 3;
+    int inst = 1;
+    const char *wav_path = nullptr;
+    const char *smf_path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            format = argv[++i];
+        } else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            chip_num = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-v") && i + 1 < argc) {
+            voice_num = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+            inst = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            wav_path = argv[++i];
+        } else if (argv[i][0] != '-' && smf_path == nullptr) {
+            smf_path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((format != "csv" && format != "json") || chip_num < 1 || chip_num > kMaxChips ||
+        voice_num < 1 || voice_num > 9 || inst < 0 || inst > 15 || smf_path == nullptr) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = open(smf_path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        perror(smf_path);
+        return 1;
+    }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    SmfMemorySource source((const uint8_t *)map, (uint32_t)st.st_size);
+    SmfSequencer sequencer;
+    if (!sequencer.begin(&source)) {
+        fprintf(stderr, "%s: not a format 0/1 standard MIDI file\n", smf_path);
+        return 1;
+    }
+    if (sequencer.getDroppedTrackNum() > 0) {
+        fprintf(stderr, "%s: %d tracks beyond the limit of %d are not played\n",
+                smf_path, sequencer.getDroppedTrackNum(), SmfSequencer::kMaxTracks);
+    }
+
+    WavWriter wav;
+    if (wav_path && !wav.open(wav_path, kRate)) {
+        perror(wav_path);
+        return 1;
+    }
+
+    Synth synth(chip_num, voice_num, inst);
+    int16_t buf[kBlockSize];
+    uint64_t sample_pos = 0;
+    uint32_t event_num = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    // each event is applied at the sample (of the 48kHz block clock) its time falls on
+    while (!sequencer.isFinished()) {
+        int pos = 0;
+        const SmfEvent *event;
+        while ((event = sequencer.peek()) != nullptr) {
+            const uint64_t event_sample = (uint64_t)event->time * kRate / 1000000;
+            if (event_sample >= sample_pos + kBlockSize) {
+                break;
+            }
+            const int offset = (int)(event_sample - sample_pos);
+            if (offset > pos) {
+                synth.render(buf + pos, offset - pos);
+                pos = offset;
+            }
+            SmfEvent e;
+            sequencer.pop(&e);
+            synth.dispatch(e);
+            event_num++;
+        }
+        if (pos < kBlockSize) {
+            synth.render(buf + pos, kBlockSize - pos);
+        }
+        sample_pos += kBlockSize;
+        wav.write(buf, kBlockSize);
+    }
+
+    // let the last notes release for a second
+    for (uint32_t i = 0; i < kRate / kBlockSize; i++) {
+        synth.render(buf, kBlockSize);
+        sample_pos += kBlockSize;
+        wav.write(buf, kBlockSize);
+    }
+    wav.close();
+
+    const double render_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double audio_seconds = (double)sample_pos / kRate;
+    const double realtime_factor = (render_seconds > 0) ? audio_seconds / render_seconds : 0;
+    if (format == "json") {
+        printf("{\"file\": \"%s\", \"format\": %d, \"tracks\": %d, \"dropped_tracks\": %d, \"events\": %u, "
+               "\"chips\": %d, \"voices\": %d, \"peak_notes\": %d, \"steals\": %u, \"audio_seconds\": %.3f, \"render_seconds\": %.3f, "
+               "\"realtime_factor\": %.2f}\n",
+               smf_path, sequencer.getFormat(), sequencer.getTrackNum(), sequencer.getDroppedTrackNum(), event_num,
+               chip_num, chip_num * voice_num, synth.getPeakHeld(), synth.getSteals(), audio_seconds, render_seconds,
+               realtime_factor);
+    } else {
+        printf("file,format,tracks,dropped_tracks,events,chips,voices,peak_notes,steals,audio_seconds,render_seconds,"
+               "realtime_factor\n");
+        printf("%s,%d,%d,%d,%u,%d,%d,%d,%u,%.3f,%.3f,%.2f\n",
+               smf_path, sequencer.getFormat(), sequencer.getTrackNum(), sequencer.getDroppedTrackNum(), event_num,
+               chip_num, chip_num * voice_num, synth.getPeakHeld(), synth.getSteals(), audio_seconds, render_seconds,
+               realtime_factor);
+    }
+
+    munmap(map, st.st_size);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * SPDX-License-Identifier: (Apache-2.0 OR LGPL-2.1-or-later)
+ *
+ * Copyright 2022 Takashi Mizuhiki
+ */
+
+// VGM (YM2413) player (host build)
+//
+// Streams the YM2413 commands of a VGM file into emu2413 as fast as possible
+// and reports the realtime factor. The file is read through mmap.
+//
+// usage: vgm_play [-f csv|json] [-r rate] [-l loops] [-o out.wav] file.vgm
+//   -f  output format (default: csv)
+//   -r  output sampling rate (default: 48000, the rate FMTGSink uses)
+//   -l  number of times the loop section is repeated (default: 0)
+//   -o  write the rendered audio to a 16-bit mono WAV file
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+
+#include "VgmPlayer.h"
+#include "common/wav_writer.h"
+
+namespace {
+
+const uint32_t kBlockSize = 240;
+
+void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-f csv|json] [-r rate] [-l loops] [-o out.wav] file.vgm\n", name);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    std::string format = "csv";
+    uint32_t rate = 48000;
+    int loop_num = 0;
+    const char *wav_path = nullptr;
+    const char *vgm_path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            format = argv[++i];
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            rate = (uint32_t)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+            loop_num = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            wav_path = argv[++i];
+        } else if (argv[i][0] != '-' && vgm_path == nullptr) {
+            vgm_path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((format != "csv" && format != "json") || rate < 8000 || loop_num < 0 || vgm_path == nullptr) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = open(vgm_path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        perror(vgm_path);
+        return 1;
+    }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    VgmMemorySource source((const uint8_t *)map, (uint32_t)st.st_size);
+    VgmPlayer player;
+    if (!player.begin(&source, rate, loop_num)) {
+        fprintf(stderr, "%s: not a VGM file\n", vgm_path);
+        return 1;
+    }
+    if (player.getClock() == 0) {
+        fprintf(stderr, "%s: no YM2413 data\n", vgm_path);
+        return 1;
+    }
+
+    OPLL *opll = OPLL_new(player.getClock(), rate);
+    OPLL_setVoiceNum(opll, 9);
+    OPLL_setAutoIdle(opll, 1);
+
+    WavWriter wav;
+    if (wav_path && !wav.open(wav_path, rate)) {
+        perror(wav_path);
+        return 1;
+    }
+
+    int16_t buf[kBlockSize];
+    uint32_t sample_num = 0;
+    double render_seconds = 0;
+    while (player.isPlaying()) {
+        const auto start = std::chrono::steady_clock::now();
+        player.render(opll, buf, kBlockSize);
+        render_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        sample_num += kBlockSize;
+        wav.write(buf, kBlockSize);
+    }
+    wav.close();
+
+    const double audio_seconds = (double)sample_num / rate;
+    const double realtime_factor = (render_seconds > 0) ? audio_seconds / render_seconds : 0;
+    if (format == "json") {
+        printf("{\"file\": \"%s\", \"clock\": %u, \"rate\": %u, \"samples\": %u, \"audio_seconds\": %.3f, "
+               "\"render_seconds\": %.3f, \"realtime_factor\": %.2f, \"stalls\": %u}\n",
+               vgm_path, player.getClock(), rate, sample_num, audio_seconds, render_seconds, realtime_factor,
+               player.getStallCount());
+    } else {
+        printf("file,clock,rate,samples,audio_seconds,render_seconds,realtime_factor,stalls\n");
+        printf("%s,%u,%u,%u,%.3f,%.3f,%.2f,%u\n",
+               vgm_path, player.getClock(), rate, sample_num, audio_seconds, render_seconds, realtime_factor,
+               player.getStallCount());
+    }
+
+    OPLL_delete(opll);
+    munmap(map, st.st_size);
+    close(fd);
+    return 0;
+}